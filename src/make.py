@@ -39,7 +39,11 @@ import shutil
 import sys
 
 # set the compiler flags
-exe_compiler_flags = ['-Wall', '-pedantic']
+exe_compiler_flags = ['-Wall', '-pedantic', '-std=c++11', '-pthread']
+
+# any arguments to this script are passed through to the compiler as extra flags
+# (e.g., 'python make.py -DSTAB_SQUISH_AOS' to set compile time options in stab_main.cpp)
+extra_compiler_flags = sys.argv[1:]
 
 # ancillary files
 ancillary_files = [ 'pthreadGC2.dll',
@@ -75,10 +79,10 @@ exe_out_path = os.path.join (bin_path, exe_name)
 print ('-------------------------------------------------------------------')
 print ('Compiling . . ')
 if os.name == 'nt':
-    exe_call = ['g++'] + exe_compiler_flags + [main] + ['-o'] + [exe_out_path]
+    exe_call = ['g++'] + exe_compiler_flags + extra_compiler_flags + [main] + ['-o'] + [exe_out_path]
 
 if os.name == 'posix':
-    exe_call = ['g++ -Wall -pedantic -O1 ' + main + ' -o ' + exe_out_path]
+    exe_call = ['g++ ' + ' '.join (exe_compiler_flags) + ' -O1 ' + ' '.join (extra_compiler_flags) + ' ' + main + ' -o ' + exe_out_path]
     
 
 ret_1 = subprocess.call (exe_call, shell = True)
@@ -96,6 +96,21 @@ class simulation {
         string existing_bsmt_file;           // existing basement file
         string existing_erodibility_file;    // existing erodibility file
         
+        // optional parameters (these can be left out of the simfile)
+        string simd;                         // vector kernel instruction set cap
+        bool seed_from_clock;                // seed the random number generator from the clock
+        unsigned long long seed;             // random number generator seed (if not from the clock)
+        bool huge_pages;                     // ask for transparent huge pages for the model memory
+        int threads;                         // number of threads for the row band work
+        bool pin_threads;                    // pin the threads to cpus (see tb_threads)
+        string numa;                         // memory placement on multi-socket computers
+        string scratch_file;                 // file to back the model memory (out-of-core), or empty
+        string squish;                       // squish algorithm (see stab::squish_sediment)
+        int poll_tile_size;                  // side of the poll tiles in cells, or 0 (see tb_poll)
+        string poll_order;                   // poll sequence generator (see tb_poll)
+        string fuse_steps;                   // run the post squish rows with the next move (see stab::move_ice_fused)
+        string schedule;                     // run the phases as sweeps or as a graph of tasks (see stab::run_step_tasks)
+        
         ifstream cfile;                      // simfile file object
         
         simulation () {
@@ -232,6 +247,49 @@ class simulation {
             existing_bsmt_file = find_header_element ("existing_bsmt_file", true);
             existing_erodibility_file = find_header_element ("existing_erodibility_file", true);
             
+            // optional parameters
+            simd = find_optional_element ("simd", "auto");
+            
+            returnstring = find_optional_element ("seed", "clock");
+            seed_from_clock = (returnstring == "clock");
+            seed = 0;
+            if (!seed_from_clock) {
+                // the seed must be a whole unsigned integer (strtoull would take '-1', or the 4 of '4a2')
+                char * seed_end;
+                errno = 0;
+                seed = strtoull (returnstring.c_str(), &seed_end, 10);
+                if (returnstring.empty () || returnstring.find_first_not_of ("0123456789") != string::npos ||
+                    *seed_end != '\0' || errno != 0) {
+                    cout << "ERROR: cannot parse the seed option (clock or a whole unsigned integer): " << returnstring << endl;
+                    exit (10);
+                }
+            }
+            
+            returnstring = find_optional_element ("huge_pages", "no");
+            huge_pages = (returnstring == "yes");
+            
+            returnstring = find_optional_element ("threads", "1");
+            threads = atoi (returnstring.c_str());
+            
+            returnstring = find_optional_element ("pin_threads", "no");
+            pin_threads = (returnstring == "yes");
+            
+            numa = find_optional_element ("numa", "first_touch");
+            
+            returnstring = find_optional_element ("scratch_file", "none");
+            scratch_file = (returnstring == "none") ? "" : returnstring;
+            
+            squish = find_optional_element ("squish", "random");
+            
+            returnstring = find_optional_element ("poll_tile_size", "0");
+            poll_tile_size = atoi (returnstring.c_str());
+            
+            poll_order = find_optional_element ("poll_order", "shuffle");
+            
+            fuse_steps = find_optional_element ("fuse_steps", "no");
+            
+            schedule = find_optional_element ("schedule", "sweeps");
+            
             cfile.close();
         }
             
@@ -297,6 +355,7 @@ class simulation {
             #endif
             
             #ifdef __linux__
+            (void)is_path;                  // paths are read as one word on linux
             cfile >> value;
             #endif
             
@@ -305,5 +364,38 @@ class simulation {
             }
             return (value);
         }
+        
+        string find_optional_element (string element, string default_value) {
+            /* method to find an optional element from the simfile and return it, or return the
+            default if the element is not in the simfile. Optional elements cannot be paths.
+            Only lines of the form '> element value' are matched, so the element name can
+            appear in the descriptions of the simfile.
+            
+            Arguments:
+            element: the element name we are searching for (tagname)
+            default_value: the value to return if the element is not present
+            */
+            
+            string value = default_value;   // value to return
+            string line;                    // a line read in from the stream
+            string marker;                  // the first word of the line
+            string text_read;               // the second word of the line
+            
+            cfile.clear();                  // clear any end of file from earlier reads
+            cfile.seekg(0);                 // rewind to beginning
+            while (getline (cfile, line)) {
+                istringstream words (line);
+                if ((words >> marker >> text_read) && marker == ">" && text_read == element) {
+                    words >> value;
+                    break;
+                }
+            }
+            cfile.clear();                  // reset the stream if we hit the end of the file
+            
+            if (verbose) {
+                cout << element << ": " << value << endl;
+            }
+            return (value);
+        }
 };
 
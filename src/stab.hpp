@@ -29,6 +29,17 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+struct alignas (64) stab_band {
+    // working space of one thread for the row sweeps, on its own cache lines (see stab::sweep)
+    int i;                                  // band index
+    uint32_t * draws;                       // random draws for a row (advection stochasticity)
+    double move_busy;                       // busy time of this thread in the move tasks (see stab::run_step_tasks)
+    double squish_busy;                     // busy time of this thread in the squish tasks (see stab::run_step_tasks)
+    #ifdef STAB_SIMD
+    simd_grid sg;                           // rasters and row buffers for the vector kernels
+    #endif
+};
+
 class stab {
     public:
         /* STAB class: this class contains the model engine and state variables. Methods defined
@@ -38,25 +49,47 @@ class stab {
         
         simulation sim;                                     // simulation parameters object
         
-        tb_raster surf;                                     // surface elevation
-        tb_raster bsmt;                                     // basement elevation
-        tb_raster ice;                                      // ice elevation
-        tb_raster n_ice;                                    // new ice elevation
+        tb_arena arena;                                     // memory for the rasters and lists below (see arena_size)
+        
+        stab_raster surf;                                   // surface elevation
+        stab_raster bsmt;                                   // basement elevation
+        stab_raster ice;                                    // ice elevation
         
-        tb_raster basal_def;                                // ice base deformation
-        tb_raster basal_pres;                               // basal pres
-        tb_raster zero_elev;                                // elevation of zero basal pres
-        tb_raster contact;                                  // contact (0 = cavity, 1 = contact)
-        tb_raster iceload;                                  // ice sediment load
-        tb_raster n_iceload;                                // new ice sediment load
+        stab_raster basal_def;                              // ice base deformation
+        stab_raster basal_pres;                             // basal pres
+        stab_raster zero_elev;                              // elevation of zero basal pres
+        stab_mask contact;                                  // contact (0 = cavity, 1 = contact)
+        stab_raster iceload;                                // ice sediment load
         
-        tb_raster dsurf;                                    // pending surface changes
-        tb_raster diceload;                                 // pending iceload changes
+        stab_raster erodibility;                            // local erodibility
         
-        tb_raster erodibility;                              // local erodibility
+        #ifdef STAB_SQUISH_AOS
+        tb_cellgrid <squish_cell> sq_cells;                 // interleaved squish records (see stab_squish.hpp)
+        #endif
         
         tb_poll p;                                          // polling engine
         stab_log sl;                                        // logging engine
+        tb_threads th;                                      // row band threads (see tb_threads.hpp)
+        bool task_schedule;                                 // run the phases as a graph of tasks (see run_step_tasks)
+        tb_tasks tasks;                                     // task graph of the phases (see tb_tasks.hpp)
+        stab_flux_log * sq_row_logs;                        // squish log sums of each row with the task schedule
+        stab_band * bands;                                  // working space for each thread (see sweep)
+        stab_flux_log * row_logs;                           // log sums of each row in a sweep (see sweep)
+        stab_flux_log * sq_logs;                            // log sums of each chunk of squish polls (see squish_sets)
+        
+        bool squish_colored;                                // run the squish a conflict free set at a time (see squish_sets)
+        uint16_t * sq_set;                                  // set of each cell, plus 1 (see color_polls)
+        int * sq_ys;                                        // polls sorted by set, ys
+        int * sq_xs;                                        // polls sorted by set, xs
+        vector <size_t> sq_set_start;                       // first poll of each set in sq_ys and sq_xs (and the end)
+        
+        bool squish_jacobi;                                 // run the squish in two passes over all the cells (see squish_two_pass)
+        stab_sq_flux * sq_flux;                             // squish from each cell to its neighbours (see squish_two_pass)
+        
+        bool fuse_steps;                                    // run the post squish rows of a step with the next move (see move_ice_fused)
+        bool post_pending;                                  // true if the post squish rows of the last step are still to run
+        int post_t;                                         // timestep of the post squish rows (see post_squish_row_cells)
+        tb_philox rng;                                      // random number generator (see tb_philox.hpp)
         
         double cell_avg_global_bf;                          // the global basal pres for present iteration
         
@@ -67,46 +100,147 @@ class stab {
         double global_yll_corner;                           // yll corner for all rasters
         double global_xll_corner;                           // xll corner for all rasters
         
+        double squish_time;                                 // wall time spent in the squish (s)
+        double move_time;                                   // wall time spent moving the ice (s)
+        double task_time;                                   // wall time spent in the task schedule (s)
+        double task_move_busy;                              // move task time averaged over the threads (s)
+        double task_squish_busy;                            // squish task time averaged over the threads (s)
+        long task_moves;                                    // iterations that moved the ice in tasks
+        
+        void (stab::*squish_polls) (squish_view &, const int *, const int *, size_t, size_t, stab_flux_log &);
+                                                            // squish kernel for the boundaries (see select_kernels)
+        void (stab::*color_polls) ();                       // squish set colouring for the boundaries (see select_kernels)
+        void (stab::*sq_flux_rows) (squish_view &, int, int, stab_flux_log *);
+                                                            // first squish pass on rows, for the boundaries (see select_kernels)
+        void (stab::*sq_gather_rows) (squish_view &, int, int);
+                                                            // second squish pass on rows, for the boundaries (see select_kernels)
+        void (stab::*post_squish_row) (int, stab_band &);   // post squish row kernel (see select_row_kernel)
+        void (stab::*post_sweep) ();                        // post squish sweep for the processes (see select_row_kernel)
+        void (stab::*step) ();                              // step function for the active processes (see select_step)
+        
+        static const bool iceload_bleed_diffusive = false;  // set whether to bleed the iceload diffusively
+        static const int squish_chunk = 256;                // polls in a chunk of a squish set (see squish_sets)
+        static const int task_rows = 8;                     // rows in a band of the task schedule (see run_step_tasks)
+        
+        // random streams: each timestep draws from its own streams (t, stream), see tb_philox.hpp
+        static const uint32_t stream_advection = 0;         // advection stochasticity, word (y * xdim) + x for cell y, x
+        static const uint32_t stream_poll = 1;              // squish polls (and stream_poll + 1, see tb_poll)
+        
+        #ifdef STAB_SIMD
+        bool simd_active;                                   // true if the vector kernels are in use (see stab_simd.hpp)
+        simd_kernels simd;                                  // vector kernels for this cpu
+        #endif
+        
         stab () {
             // constructor is just a placeholder, must call init to initialize the engine
         }
         
-        void init (string simfilename) {
+        void init (string simfilename, int threads = 0) {
             /* method to initialize the model engine
 
             simfilename = string of the simfile location
+            threads = the number of threads, or 0 to take the simfile threads key
             */
             
             cout << "Initializing STAB model engine . . ";
             
-            // seed the twister
-            timeval tm;                                     // create a timeval to seed the twister
-            gettimeofday(&tm, NULL);                        // get the time right now
-            init_genrand (tm.tv_usec);                      // and . . seed with milliseconds
-
             // read the simfile by initializing the sim object
             sim.init (simfilename);
             
+            // seed the generator, with the simfile seed if there is one (to repeat a run)
+            uint64_t seed = sim.seed;
+            if (sim.seed_from_clock) {
+                timeval tm;                                 // create a timeval to seed the generator
+                gettimeofday(&tm, NULL);                    // get the time right now
+                seed = ((uint64_t)tm.tv_sec * 1000000) + tm.tv_usec;
+            }
+            rng.init (seed);
+            cout << "seed: " << seed << " . . ";
+            
             // check the ice_advection rate
             if ((sim.ice_advection * sim.len_timestep) > sim.cellsize) {
                 cout << "ERROR: ice_advection * len_timestep is greater than one cellsize" << endl;
                 exit (10);
             }
             
-            // initialize the rasters
-            surf.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew);
-            bsmt.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew);
-            ice.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew);
-            n_ice.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew);
-            basal_def.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew);
-            basal_pres.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew);
-            zero_elev.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew);
-            contact.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew);
-            iceload.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew);
-            n_iceload.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew);
-            dsurf.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew);
-            diceload.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew);
-            erodibility.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew);
+            // the threads come first, the arena holds working space for each thread
+            th.init ((threads > 0) ? threads : sim.threads, sim.pin_threads);
+            
+            // the squish algorithm, the colored and jacobi squishes need their own lists
+            if (sim.squish != "random" && sim.squish != "colored" && sim.squish != "jacobi") {
+                cout << "ERROR: cannot parse the squish option: " << sim.squish << endl;
+                exit (10);
+            }
+            squish_colored = (sim.squish == "colored");
+            squish_jacobi = (sim.squish == "jacobi");
+            if (sim.poll_tile_size < 0 || sim.poll_tile_size > 65535) {
+                cout << "ERROR: poll_tile_size must be from 0 to 65535: " << sim.poll_tile_size << endl;
+                exit (10);
+            }
+            if (sim.poll_order != "shuffle" && sim.poll_order != "hash") {
+                cout << "ERROR: cannot parse the poll_order option: " << sim.poll_order << endl;
+                exit (10);
+            }
+            if (sim.poll_order == "hash" && sim.poll_tile_size > 0) {
+                cout << "ERROR: the hash poll_order cannot be used with poll_tile_size" << endl;
+                exit (10);
+            }
+            if (sim.fuse_steps != "yes" && sim.fuse_steps != "no") {
+                cout << "ERROR: cannot parse the fuse_steps option: " << sim.fuse_steps << endl;
+                exit (10);
+            }
+            fuse_steps = (sim.fuse_steps == "yes");
+            if (sim.schedule != "sweeps" && sim.schedule != "tasks") {
+                cout << "ERROR: cannot parse the schedule option: " << sim.schedule << endl;
+                exit (10);
+            }
+            task_schedule = (sim.schedule == "tasks");
+            if (task_schedule && !squish_jacobi) {
+                cout << "ERROR: the tasks schedule needs the jacobi squish (the other squishes visit the whole grid in order)" << endl;
+                exit (10);
+            }
+            if (task_schedule && fuse_steps) {
+                cout << "ERROR: the tasks schedule cannot be used with fuse_steps" << endl;
+                exit (10);
+            }
+            post_pending = false;
+            post_t = 0;
+            
+            // take the memory for the engine from one arena
+            arena.init (arena_size (), sim.huge_pages, sim.scratch_file);
+            cout << "memory: " << arena.len / (1024.0 * 1024.0) << " MB" << (arena.huge_pages ? " in huge pages" : "") <<
+                    (arena.mapped ? " in scratch file" : "") << " . . ";
+            cout << "threads: " << th.n << (th.pinned ? " pinned" : "") << " . . ";
+            cout << "squish: " << sim.squish << " . . ";
+            if (sim.poll_tile_size > 0) {
+                cout << "poll tiles: " << sim.poll_tile_size << " x " << sim.poll_tile_size << " . . ";
+            }
+            cout << "poll order: " << sim.poll_order << " . . ";
+            if (fuse_steps) {
+                cout << "fused steps . . ";
+            }
+            if (task_schedule) {
+                cout << "task schedule . . ";
+            }
+            
+            // initialize the rasters, the full rasters are filled in first_touch
+            surf.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew, &arena, false);
+            bsmt.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew, &arena, false);
+            ice.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew, &arena, false);
+            basal_def.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew, &arena, false);
+            basal_pres.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew, &arena, false);
+            zero_elev.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew, &arena, false);
+            contact.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew, &arena, false);
+            iceload.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew, &arena, false);
+            erodibility.init (sim.ydim, sim.xdim, sim.yll_corner, sim.xll_corner, sim.cellsize, sim.boundaries_ns, sim.boundaries_ew, &arena, false);
+            
+            #ifdef STAB_SQUISH_AOS
+            sq_cells.init (sim.ydim, sim.xdim, &arena);
+            #endif
+            
+            first_touch ();
+            
+            select_kernels ();
             
             // assign initial values to the rasters
             if (sim.init_type == "flat") {
@@ -119,13 +253,53 @@ class stab {
             }
             
             // initialize the polling engine
-            p.init (sim.ydim, sim.xdim);
+            p.init (sim.ydim, sim.xdim, &arena, sim.poll_tile_size, (sim.poll_order == "hash") ? &th : NULL);
+            
+            // set up the working space for the threads, and the row log sums
+            bands = arena.take <stab_band> (th.n);
+            for (int i = 0; i < th.n; i++) {
+                bands[i] = stab_band ();
+                bands[i].i = i;
+                bands[i].draws = arena.take <uint32_t> (sim.xdim);
+            }
+            row_logs = arena.take <stab_flux_log> (sim.ydim);
+            sq_logs = arena.take <stab_flux_log> (squish_chunks ());
+            if (squish_colored) {
+                sq_set = arena.take <uint16_t> (p.len);
+                sq_ys = arena.take <int> (p.len);
+                sq_xs = arena.take <int> (p.len);
+            }
+            if (squish_jacobi) {
+                sq_flux = arena.take <stab_sq_flux> (p.len);
+            }
+            if (task_schedule) {
+                // the squish passes read the bands on either side, the rest only their own band
+                const int reach[4] = {0, 1, 1, 0};
+                tasks.init (sim.ydim, task_rows, 4, reach, surf.b.periodic_ns, th.n);
+                sq_row_logs = arena.take <stab_flux_log> (sim.ydim);
+            }
             
             // set the basal pres
             cell_avg_global_bf = sim.global_basal_pres;
             
-            // set basal_pres_fudge
-            basal_pres_fudge = 1.0e-12 * sim.global_basal_pres; 
+            // set basal_pres_fudge, wider with float state rasters (see STAB_FLOAT): a cavity keeps the basal
+            // deformation of zero basal pres, and stored in float this can give a basal pres of about
+            // eps / 2 * global basal pres, enough to put a cavity in contact with the ice when it takes squish
+            basal_pres_fudge = max (1.0e-12, 16.0 * numeric_limits <stab_real>::epsilon ()) * sim.global_basal_pres;
+            
+            squish_time = 0.0;
+            move_time = 0.0;
+            task_time = 0.0;
+            task_move_busy = 0.0;
+            task_squish_busy = 0.0;
+            task_moves = 0;
+            
+            #ifdef STAB_SIMD
+            select_simd ();
+            #endif
+            
+            // report where the engine memory ended up (see first_touch)
+            cout << "memory nodes: " << tb_numa_nodes () << ", page placement: " << tb_numa_report (arena.block, arena.len) << " . . ";
             
             // initialize the logging engine and create the status report
             sl.init ();
@@ -138,32 +312,465 @@ class stab {
             cout << "complete" << endl;
         }
 
+        void first_touch () {
+            /* method to fill the full rasters with nodata for the first time, a band of rows per
+            thread with the same bands as the threaded kernels. A page is placed in the memory of the
+            socket whose thread first writes it, so this keeps each band's pages next to the thread
+            that works on them. The sim.numa option changes this:
+            
+            first_touch = leave the placement to the first write (the default)
+            interleave = spread the pages of the arena across all the memory nodes in turn
+            bind = bind the pages of each band to a node, with the bands spread across the nodes in order
+            
+            The placement achieved is reported at the end of init.
+            */
+            int nodes = tb_numa_nodes ();
+            bool placed = true;
+            vector <char> band_placed (th.n, 1);                // bind results for each band
+            
+            if (sim.numa == "interleave") {
+                placed = tb_numa_interleave (arena.block, arena.len, nodes);
+            } else if (sim.numa != "bind" && sim.numa != "first_touch") {
+                cout << "ERROR: cannot parse the numa option: " << sim.numa << endl;
+                exit (10);
+            }
+            
+            stab_raster * rasters[] = {&surf, &bsmt, &ice, &basal_def, &basal_pres, &zero_elev, &iceload, &erodibility};
+            int n_rasters = sizeof (rasters) / sizeof (rasters[0]);
+            
+            th.run (sim.ydim, [&] (int y0, int y1, int i) {
+                char * band_p;
+                size_t band_len;
+                
+                if (sim.numa == "bind") {
+                    int node = (i * nodes) / th.n;
+                    for (int r = 0; r < n_rasters; r++) {
+                        rasters[r]->band_span (y0, y1, band_p, band_len);
+                        band_placed[i] = tb_numa_bind (band_p, band_len, node) && band_placed[i];
+                    }
+                    contact.band_span (y0, y1, band_p, band_len);
+                    band_placed[i] = tb_numa_bind (band_p, band_len, node) && band_placed[i];
+                }
+                
+                for (int r = 0; r < n_rasters; r++) {
+                    rasters[r]->setnull_rows (y0, y1);
+                }
+                contact.setnull_rows (y0, y1);
+                
+                #ifdef STAB_SQUISH_AOS
+                for (int y = y0; y < y1; y++) {
+                    for (int x = 0; x < sim.xdim; x++) {
+                        sq_cells (y, x) = squish_cell ();
+                    }
+                }
+                #endif
+            });
+            
+            for (int i = 0; i < th.n; i++) {
+                placed = placed && band_placed[i];
+            }
+            if (!placed) {
+                cout << "WARNING: cannot set the numa policy . . ";
+            }
+        }
+        
+        size_t arena_size () {
+            /* method to return the bytes of arena needed for the engine rasters and lists (these
+            must match what is taken from the arena in init and select_simd)
+            */
+            size_t len = (8 * stab_raster::mem_size (sim.ydim, sim.xdim)) +        // full rasters
+                         stab_mask::mem_size (sim.ydim, sim.xdim) +                 // contact
+                         tb_poll::mem_size (sim.ydim, sim.xdim, sim.poll_order == "hash") +
+                         tb_arena::round (th.n * sizeof (stab_band)) +
+                         (th.n * tb_arena::round (sim.xdim * sizeof (uint32_t))) +
+                         tb_arena::round (sim.ydim * sizeof (stab_flux_log)) +
+                         tb_arena::round (squish_chunks () * sizeof (stab_flux_log));
+            
+            if (squish_colored) {
+                size_t cells = (size_t)sim.ydim * sim.xdim;
+                len = len + tb_arena::round (cells * sizeof (uint16_t)) + (2 * tb_arena::round (cells * sizeof (int)));
+            }
+            if (squish_jacobi) {
+                len = len + tb_arena::round ((size_t)sim.ydim * sim.xdim * sizeof (stab_sq_flux));
+            }
+            if (task_schedule) {
+                len = len + tb_arena::round (sim.ydim * sizeof (stab_flux_log));
+            }
+            
+            #ifdef STAB_SQUISH_AOS
+            len = len + tb_cellgrid <squish_cell>::mem_size (sim.ydim, sim.xdim);
+            #endif
+            
+            #ifdef STAB_SIMD
+            len = len + th.n * ((3 * tb_arena::round ((sim.xdim + (2 * simd_max_width)) * sizeof (double))) +
+                                (2 * tb_arena::round ((sim.xdim + (2 * simd_max_width)) * sizeof (stab_real))));
+            #endif
+            return (len);
+        }
+        
+        size_t squish_chunks () {
+            // method to return the most chunks of squish polls in a set (see squish_sets)
+            return ((((size_t)sim.ydim * sim.xdim) / squish_chunk) + 1);
+        }
+        
+        void select_kernels () {
+            /* method to pick the kernel instantiations that match the boundaries. The squish and
+            advection kernels are templated on whether the north-south and east-west boundaries are
+            periodic, so the boundary handling is resolved at compile time (see tb_edge in
+            tb_boundaries.hpp) rather than with lookups and toxic_coord tests on every cell.
+            */
+            bool periodic_ns = surf.b.periodic_ns;
+            bool periodic_ew = surf.b.periodic_ew;
+            
+            if (periodic_ns && periodic_ew) {
+                squish_polls = &stab::squish_sediment_polls <squish_view, true, true>;
+                color_polls = &stab::color_polls_sets <true, true>;
+                sq_flux_rows = &stab::squish_flux_rows <squish_view, true, true>;
+                sq_gather_rows = &stab::squish_gather_rows <squish_view, true, true>;
+            } else if (periodic_ns && !periodic_ew) {
+                squish_polls = &stab::squish_sediment_polls <squish_view, true, false>;
+                color_polls = &stab::color_polls_sets <true, false>;
+                sq_flux_rows = &stab::squish_flux_rows <squish_view, true, false>;
+                sq_gather_rows = &stab::squish_gather_rows <squish_view, true, false>;
+            } else if (!periodic_ns && periodic_ew) {
+                squish_polls = &stab::squish_sediment_polls <squish_view, false, true>;
+                color_polls = &stab::color_polls_sets <false, true>;
+                sq_flux_rows = &stab::squish_flux_rows <squish_view, false, true>;
+                sq_gather_rows = &stab::squish_gather_rows <squish_view, false, true>;
+            } else {
+                squish_polls = &stab::squish_sediment_polls <squish_view, false, false>;
+                color_polls = &stab::color_polls_sets <false, false>;
+                sq_flux_rows = &stab::squish_flux_rows <squish_view, false, false>;
+                sq_gather_rows = &stab::squish_gather_rows <squish_view, false, false>;
+            }
+            
+            select_step ();
+        }
+        
+        void select_step () {
+            /* method to pick the step function instantiation for the processes that are active in
+            the simfile. Processes that are switched off (all abrasion parameters zero, zero bleeds)
+            are compiled out of the step rather than swept over the grid with zero rates. Note there
+            is no fudge in these tests as they are straight param reads.
+            */
+            bool erosion = (sim.abrasion_from_N_zero != 0.0 || sim.abrasion_from_N_slope != 0.0 ||
+                            sim.abrasion_from_iceload != 0.0);
+            
+            if (erosion) {
+                select_step_bleeds <true> ();
+            } else {
+                select_step_bleeds <false> ();
+            }
+        }
+        
+        template <bool erosion>
+        void select_step_bleeds () {
+            // method to finish picking the step function instantiation (see select_step)
+            bool bleed_surf = (sim.surf_bleed != 0.0);
+            bool bleed_iceload = (sim.iceload_bleed != 0.0);
+            
+            if (bleed_surf && bleed_iceload) {
+                select_row_kernel <erosion, true, true, iceload_bleed_diffusive> ();
+            } else if (bleed_surf && !bleed_iceload) {
+                select_row_kernel <erosion, true, false, iceload_bleed_diffusive> ();
+            } else if (!bleed_surf && bleed_iceload) {
+                select_row_kernel <erosion, false, true, iceload_bleed_diffusive> ();
+            } else {
+                select_row_kernel <erosion, false, false, iceload_bleed_diffusive> ();
+            }
+        }
+        
+        template <bool erosion, bool bleed_surf, bool bleed_iceload, bool bleed_diffusive>
+        void select_row_kernel () {
+            /* method to set the step function for the processes, and pick the post squish row kernel
+            for the processes, the east-west boundary, and whether the advection is stochastic (see
+            post_squish_row_cells)
+            */
+            bool periodic_ew = surf.b.periodic_ew;
+            bool stochastic = (sim.Q_advection_stochasticity != 0.0);
+            
+            step = &stab::run_step <erosion, bleed_surf, bleed_iceload, bleed_diffusive>;
+            post_sweep = &stab::advect_erode_sediment <erosion, bleed_surf, bleed_iceload, bleed_diffusive>;
+            if (periodic_ew && stochastic) {
+                post_squish_row = &stab::post_squish_row_cells <true, true, erosion, bleed_surf, bleed_iceload, bleed_diffusive>;
+            } else if (periodic_ew && !stochastic) {
+                post_squish_row = &stab::post_squish_row_cells <true, false, erosion, bleed_surf, bleed_iceload, bleed_diffusive>;
+            } else if (!periodic_ew && stochastic) {
+                post_squish_row = &stab::post_squish_row_cells <false, true, erosion, bleed_surf, bleed_iceload, bleed_diffusive>;
+            } else {
+                post_squish_row = &stab::post_squish_row_cells <false, false, erosion, bleed_surf, bleed_iceload, bleed_diffusive>;
+            }
+        }
+        
+        #ifdef STAB_SIMD
+        void select_simd () {
+            /* method to pick the vector kernels for this cpu (see stab_simd.hpp) and point them at the
+            engine rasters, with row buffers for each thread. This needs the basal pres to be set.
+            */
+            simd_grid sg;
+            simd_active = simd_select (simd, sim.simd);
+            
+            if (simd_active) {
+                cout << "vector kernels: " << simd.name << " . . ";
+            } else {
+                cout << "vector kernels: off . . ";
+            }
+            
+            sg.surf = surf.ras;
+            sg.bsmt = bsmt.ras;
+            sg.ice = ice.ras;
+            sg.basal_def = basal_def.ras;
+            sg.basal_pres = basal_pres.ras;
+            sg.zero_elev = zero_elev.ras;
+            sg.contact = contact.ras;
+            sg.iceload = iceload.ras;
+            sg.erodibility = erodibility.ras;
+            sg.ydim = sim.ydim;
+            sg.xdim = sim.xdim;
+            
+            // these are calculated as in the scalar methods, so the values are the same
+            sg.t_wgt = 1.0 - ((sim.ice_advection * sim.len_timestep) / sim.cellsize);
+            sg.w_wgt = (sim.ice_advection * sim.len_timestep) / sim.cellsize;
+            sg.zero_elev_shift = (cell_avg_global_bf * sim.len_timestep) / sim.viscosity;
+            sg.basal_force = cell_avg_global_bf;
+            sg.basal_pres_fudge = basal_pres_fudge;
+            sg.len_timestep = sim.len_timestep;
+            sg.viscosity = sim.viscosity;
+            sg.cellsize = sim.cellsize;
+            sg.Q_advection_global = sim.Q_advection_global;
+            sg.Q_advection_stochasticity = sim.Q_advection_stochasticity;
+            sg.entrainment_cavity = sim.entrainment_cavity;
+            sg.entrainment_zero = sim.entrainment_zero;
+            sg.entrainment_slp_1 = sim.entrainment_slp_1;
+            sg.entrainment_vtx_2 = sim.entrainment_vtx_2;
+            sg.entrainment_slp_2 = sim.entrainment_slp_2;
+            sg.abrasion_from_N_zero = sim.abrasion_from_N_zero;
+            sg.abrasion_from_N_slope = sim.abrasion_from_N_slope;
+            sg.abrasion_from_iceload = sim.abrasion_from_iceload;
+            sg.global_bsmt_erodibility = sim.global_bsmt_erodibility;
+            sg.iceload_surf_return_fraction = sim.iceload_surf_return_fraction;
+            sg.surf_bleed = sim.surf_bleed;
+            sg.iceload_bleed = sim.iceload_bleed;
+            
+            // each thread gets a copy, with its own row buffers, padded for a whole vector past xdim
+            // (and Q_ad_row, ice_row, and iceload_row [-1])
+            int row_len = sim.xdim + (2 * simd_max_width);
+            for (int i = 0; i < th.n; i++) {
+                simd_grid & g = bands[i].sg;
+                g = sg;
+                g.rand_row = arena.take <double> (row_len);
+                g.Q_ad_row = arena.take <double> (row_len) + simd_max_width;
+                g.Q_en_row = arena.take <double> (row_len);
+                g.ice_row = arena.take <stab_real> (row_len) + simd_max_width;
+                g.iceload_row = arena.take <stab_real> (row_len) + simd_max_width;
+                memset (g.ice_row - simd_max_width, 0, row_len * sizeof (stab_real));
+                memset (g.iceload_row - simd_max_width, 0, row_len * sizeof (stab_real));
+                g.Q_ad_row[-1] = 0.0;
+            }
+        }
+        #endif
+        
+        template <class job_t>
+        void sweep (job_t job) {
+            /* method to run a job over the rows of the grid, a band of rows per thread (see
+            tb_threads). The job is called as job (y0, y1, b) for the rows y0 up to y1 with the
+            working space b of the thread, and sums the logs of row y into row_logs[y]. The row
+            logs are then added to the logs in row order, so the logs are the same whatever the
+            number of threads.
+            job = the job (e.g., a lambda)
+            */
+            th.run (sim.ydim, [&] (int y0, int y1, int i) {
+                for (int y = y0; y < y1; y++) {
+                    row_logs[y].reset ();
+                }
+                job (y0, y1, bands[i]);
+            });
+            for (int y = 0; y < sim.ydim; y++) {
+                sl.add_fluxes (row_logs[y]);
+            }
+        }
+        
         void run () {
+            /* method to push model forward one iteration, with the step function picked at init
+            for the active processes (see select_step).
+            */
+            (this->*step) ();
+        }
+        
+        template <bool erosion, bool bleed_surf, bool bleed_iceload, bool bleed_diffusive>
+        void run_step () {
             /* method to push model forward one iteration. This method moves the ice, then potentially
             pushes the model state outputs, then goes ahead and squishes the sediment, and advects
             and entrains the sediment, and finally applies changes to the surface raster.
+            
+            With fuse_steps, the advection and the rest after the squish are left pending, and run
+            a row at a time with the move of the next iteration (see move_ice_fused), or in finalize
+            after the last iteration.
+            
+            erosion = true if basement abrasion is active, else the basement erosion pass only
+                keeps the surface on exposed basement
+            bleed_surf = true if the surface bleed is active
+            bleed_iceload = true if the iceload bleed is active
+            bleed_diffusive = true to bleed the iceload diffusively
             */
             
-            move_ice ();                            // move the ice downflow
+            if (task_schedule) {
+                run_step_tasks ();                  // the same steps as a graph of tasks
+                return;
+            }
+            
+            if (post_pending) {
+                move_ice_fused ();                  // finish the last iteration with the move (see fuse_steps)
+            } else {
+                move_ice ();                        // move the ice downflow
+            }
 
             if (t % sim.interim_file_output_interval == 0) {
                 push_model_state ();                // push file outputs to disk
             }
             
             squish_sediment ();                     // squish sediment laterally based on pressure differences            
-            advect_entrainment ();                  // perform advection and entrainment
-            erode_basement ();                      // erode basement
-            apply_dsurf ();                         // apply the pending changes to surf
-            surf_bleed ();                          // apply surface bleed to the model space
-            iceload_bleed ();                       // apply changes to the iceload
+            post_t = t;
+            if (fuse_steps) {
+                post_pending = true;                // left for the next move (see move_ice_fused)
+            } else {
+                advect_erode_sediment <erosion, bleed_surf, bleed_iceload, bleed_diffusive> ();
+                                                    // perform advection and entrainment, erode basement, apply changes, and bleed
+            }
+        }
+        
+        void run_step_tasks () {
+            /* method to push the model forward one iteration as a graph of tasks on bands of rows (see
+            tb_tasks.hpp), with the jacobi squish. This runs the same steps as run_step, on each band:
+            
+            0. move the ice (see move_ice_rows), then pack the squish records with STAB_SQUISH_AOS
+            1. the first squish pass (see squish_flux_rows), which reads the rows next to the band
+            2. the second squish pass (see squish_gather_rows), which reads the squish of the rows
+               next to the band, and writes the cells that the first pass next to the band reads
+            3. unpack the squish records with STAB_SQUISH_AOS, then the post squish rows (see
+               post_squish_row_cells), which only work in their own rows
+            
+            So phases 1 and 2 wait for the phase before on the band and the bands either side, and
+            phase 3 waits for phase 2 on the band: a band can be in the post squish rows while bands
+            further on are still squishing, and the threads take tasks from each other as they run
+            out, rather than all waiting for the slowest band at the end of each sweep. Each task only
+            writes its own rows, so the rasters are the same as run_step. The squish logs of the rows
+            are kept apart from the post squish logs, and added first, in the order of the sweeps.
+            
+            On iterations with model state outputs the ice is moved with move_ice first, as the
+            outputs come between the move and the squish.
+            
+            The phases of different bands overlap, so there is no wall time for each phase. Each
+            thread times its own move and squish tasks (the squish with the packing as in
+            squish_sediment), and these busy times averaged over the threads are kept apart from the
+            wall times of the sweeps (see finalize).
+            */
+            double start_time = wall_clock ();
+            bool moved = (t % sim.interim_file_output_interval == 0);
+            
+            if (moved) {
+                move_ice ();
+                push_model_state ();                // push file outputs to disk
+            } else {
+                ice.refresh_halo ();                // the west neighbour for the move is x - 1
+                iceload.refresh_halo ();
+            }
+            
+            #ifdef STAB_SQUISH_AOS
+            squish_view v (sq_cells);
+            #else
+            squish_view v = soa_view ();
+            #endif
+            
+            for (int y = 0; y < sim.ydim; y++) {
+                sq_row_logs[y].reset ();
+                row_logs[y].reset ();
+            }
+            post_t = t;
+            
+            for (int i = 0; i < th.n; i++) {
+                bands[i].move_busy = 0.0;
+                bands[i].squish_busy = 0.0;
+            }
+            
+            tasks.run (th, [&] (int phase, int y0, int y1, int i) {
+                stab_band & b = bands[i];
+                double task_start = wall_clock ();
+                if (phase == 0) {
+                    if (!moved) {
+                        move_ice_rows (y0, y1, b);
+                    }
+                    #ifdef STAB_SQUISH_AOS
+                    double pack_start = wall_clock ();
+                    b.move_busy = b.move_busy + (pack_start - task_start);
+                    pack_squish_rows (y0, y1);
+                    b.squish_busy = b.squish_busy + (wall_clock () - pack_start);
+                    #else
+                    b.move_busy = b.move_busy + (wall_clock () - task_start);
+                    #endif
+                } else if (phase == 1) {
+                    (this->*sq_flux_rows) (v, y0, y1, sq_row_logs);
+                    b.squish_busy = b.squish_busy + (wall_clock () - task_start);
+                } else if (phase == 2) {
+                    (this->*sq_gather_rows) (v, y0, y1);
+                    b.squish_busy = b.squish_busy + (wall_clock () - task_start);
+                } else {
+                    #ifdef STAB_SQUISH_AOS
+                    unpack_squish_rows (y0, y1);
+                    b.squish_busy = b.squish_busy + (wall_clock () - task_start);
+                    #endif
+                    for (int y = y0; y < y1; y++) {
+                        basal_pres.refresh_halo_row (y);     // east neighbour for calc_advection is x + 1
+                        (this->*post_squish_row) (y, b);
+                    }
+                }
+            });
+            
+            for (int y = 0; y < sim.ydim; y++) {
+                sl.add_fluxes (sq_row_logs[y]);
+            }
+            for (int y = 0; y < sim.ydim; y++) {
+                sl.add_fluxes (row_logs[y]);
+            }
+            for (int i = 0; i < th.n; i++) {
+                task_move_busy = task_move_busy + (bands[i].move_busy / th.n);
+                task_squish_busy = task_squish_busy + (bands[i].squish_busy / th.n);
+            }
+            if (!moved) {
+                task_moves++;
+            }
+            
+            task_time = task_time + (wall_clock () - start_time);
         }
         
         void finalize () {
             /* method to finalize the model space and shut down model engine.
             */
 
+            p.finish ();                                    // stop making poll sequences (see tb_poll)
+            if (post_pending) {
+                (this->*post_sweep) ();                     // finish the last iteration (see fuse_steps)
+                post_pending = false;
+            }
             push_model_state ();
             
+            // report the squish and move timing (wall times of the sweeps), to compare the squish layouts
+            // (see stab_squish.hpp) and the ice move
+            double cells = (double)sim.ydim * sim.xdim;
+            if (!task_schedule) {
+                cout << "Squish time per cell visit: " << (1.0e9 * squish_time) / (cells * t) << " ns" << endl;
+                cout << "Move ice time per cell: " << (1.0e9 * move_time) / (cells * t) << " ns" <<
+                        (fuse_steps ? " (with the fused post squish rows)" : "") << endl;
+            } else {
+                // the phases overlap in the task schedule, so only the whole schedule has a wall time, and
+                // the move and squish are the busy times of the threads in these tasks, averaged over the threads
+                cout << "Task schedule wall time per cell (move, squish and post squish): " << (1.0e9 * task_time) / (cells * t) << " ns" << endl;
+                cout << "Task schedule squish average thread busy time per cell visit: " << (1.0e9 * task_squish_busy) / (cells * t) << " ns" << endl;
+                if (task_moves > 0) {
+                    cout << "Task schedule move ice average thread busy time per cell: " << (1.0e9 * task_move_busy) / (cells * task_moves) << " ns" << endl;
+                }
+            }
+            
             // if we weren't making images on the fly, we can call the image script and make them now
             if (!sim.on_the_fly_progress_updates) {
                 // call with -1 flag to make all images at the end
@@ -242,8 +849,6 @@ class stab {
             
             cout << "surf: ";
             surf.print_summary ();
-            cout << "dsurf: ";
-            dsurf.print_summary ();
             cout << "ice: ";
             ice.print_summary ();
             cout << "basal_def: ";
@@ -257,85 +862,220 @@ class stab {
         }
         
         void init_flat () {
-            /* method to initialize the model space with a flat surface
+            /* method to initialize the model space with a flat surface, by row bands (see first_touch)
             */
-            surf.setvalue (sim.flat_init_sedfill_elev);
-            bsmt.setvalue (sim.flat_init_basement_elev);
-            erodibility.setvalue (0.0);
-            ice.copy_rastercells (surf);
-            iceload.setvalue (sim.init_iceload);
-            contact.setvalue (1.0);
+            th.run (sim.ydim, [&] (int y0, int y1, int) {
+                surf.setvalue_rows (sim.flat_init_sedfill_elev, y0, y1);
+                bsmt.setvalue_rows (sim.flat_init_basement_elev, y0, y1);
+                erodibility.setvalue_rows (0.0, y0, y1);
+                ice.copy_rastercells (surf, y0, y1);
+                iceload.setvalue_rows (sim.init_iceload, y0, y1);
+                contact.setvalue_rows (1, y0, y1);
+            });
         }
         
         void init_existing () {
-            /* method to initialize the model space with existing surface and basement files
+            /* method to initialize the model space with existing surface and basement files. The
+            files are read in serially (the pages are already placed, see first_touch), the rest is
+            by row bands.
             */
             surf.read_ascii_raster (sim.existing_surf_file);
             bsmt.read_ascii_raster (sim.existing_bsmt_file);
             erodibility.read_ascii_raster (sim.existing_erodibility_file);
-            ice.copy_rastercells (surf);
-            iceload.setvalue (sim.init_iceload);
-            contact.setvalue (1.0);
+            th.run (sim.ydim, [&] (int y0, int y1, int) {
+                ice.copy_rastercells (surf, y0, y1);
+                iceload.setvalue_rows (sim.init_iceload, y0, y1);
+                contact.setvalue_rows (1, y0, y1);
+            });
         }    
                        
         void move_ice () {
-            /* method to move the ice downflow 1 timestep and set pres rasters
+            /* method to move the ice downflow 1 timestep and set pres rasters. Each row only
+            depends on itself, so the rows are moved a band per thread (see sweep). The ice and
+            iceload are updated in place (see move_ice_rows), so there are no new rasters to copy
+            back or swap in. The timing is reported in finalize.
+            */
+            
+            double start_time = wall_clock ();
+            
+            // refresh the halos so the west neighbour is simply x - 1
+            ice.refresh_halo ();
+            iceload.refresh_halo ();
+            
+            sweep ([&] (int y0, int y1, stab_band & b) {
+                move_ice_rows (y0, y1, b);
+            });
+            
+            move_time = move_time + (wall_clock () - start_time);
+        }
+        
+        void move_ice_fused () {
+            /* method to run the post squish rows of the last iteration (see advect_erode_sediment) and
+            then move the ice, a row at a time, so each row is still in cache for the move. The
+            squish touches the whole grid, so this is as far as the steps can be blocked: the post
+            squish rows and the move are the two sweeps with nothing global between them. Each only
+            works in its own row (the advection reads the basal pres to the east, which the move
+            then sets), so this gives the same rasters and logs as running the two sweeps in turn.
+            The move timing includes the post squish rows.
+            */
+            double start_time = wall_clock ();
+            
+            // refresh the halos, the iceload west halo is refreshed for each row after the post squish row
+            basal_pres.refresh_halo ();
+            ice.refresh_halo ();
+            
+            sweep ([&] (int y0, int y1, stab_band & b) {
+                for (int y = y0; y < y1; y++) {
+                    (this->*post_squish_row) (y, b);    // row kernel for the boundaries and processes (see select_row_kernel)
+                    iceload.refresh_halo_row (y);
+                    move_ice_rows (y, y + 1, b);
+                }
+            });
+            post_pending = false;
+            
+            move_time = move_time + (wall_clock () - start_time);
+        }
+        
+        void move_ice_rows (int y0, int y1, stab_band & b) {
+            /* method to move the ice in rows y0 to y1 - 1. The ice and iceload are updated in place,
+            carrying the old values of the west cell along the row. The halos must be current.
+            
+            There is no separate path for ice that moves exactly one cell a timestep (w_wgt = 1).
+            Only the iceload is then a pure shift: the ice is reset to the surf or the zero elev,
+            and zero_elev, basal_def, basal_pres and contact are written for every cell in any case,
+            so the move stays a pass over every cell. A rotating x origin for the iceload would
+            have to be followed by every kernel that reads it, for no saving in the move.
+            b = the working space of the thread
             */
             double t_wgt;               // target cell weight
             double w_wgt;               // west cell weight
             double ice_temploc;         // ice temporary location
+            double ice_zero_elev;       // elevation of zero basal pres (kept in double, see STAB_FLOAT)
+            stab_real ice_w;            // old ice elevation of the west cell
+            stab_real ice_t;            // old ice elevation of the target cell
+            stab_real iceload_w;        // old iceload of the west cell
+            stab_real iceload_t;        // old iceload of the target cell
+            squish_soa_view v = soa_view ();
             
             t_wgt = 1.0 - ((sim.ice_advection * sim.len_timestep) / sim.cellsize);
             w_wgt = (sim.ice_advection * sim.len_timestep) / sim.cellsize;
             
-            for (int y = 0; y < sim.ydim; y++) {
+            #ifdef STAB_SIMD
+            if (simd_active) {
+                simd.move_ice (b.sg, y0, y1);
+                return;
+            }
+            #else
+            (void)b;                    // only the vector kernels use the working space
+            #endif
+            
+            for (int y = y0; y < y1; y++) {
+                ice_w = ice.ras[y][-1];
+                iceload_w = iceload.ras[y][-1];
                 for (int x = 0; x < sim.xdim; x++) {
+                    ice_t = ice.ras[y][x];
+                    iceload_t = iceload.ras[y][x];
                     
                     // calculate temporary height of the ice based on shift
-                    ice_temploc = (w_wgt * ice.ras[y][ice.b.w1[x]]) + (t_wgt * ice.ras[y][x]);
-                    zero_elev.ras[y][x] = ice_temploc - ((cell_avg_global_bf * sim.len_timestep) / sim.viscosity);
+                    ice_temploc = (w_wgt * ice_w) + (t_wgt * ice_t);
+                    ice_zero_elev = ice_temploc - ((cell_avg_global_bf * sim.len_timestep) / sim.viscosity);
+                    zero_elev.ras[y][x] = ice_zero_elev;
                     
                     // assign basal deformation and basal pres
                     basal_def.ras[y][x] = surf.ras[y][x] - ice_temploc;             // deformation this timestep
-                    calc_basal_pres (y, x);
+                    calc_basal_pres (v, y, x);
                     
                     // if there is no contact (e.g., a cavity), we need to reassign everything
-                    if (contact.ras[y][x] == 0.0) {
-                        basal_def.ras[y][x] = zero_elev.ras[y][x] - ice_temploc;  // set negative deformation
-                        n_ice.ras[y][x] = zero_elev.ras[y][x];                    // set new ice elevation
+                    if (contact.ras[y][x] == 0) {
+                        basal_def.ras[y][x] = ice_zero_elev - ice_temploc;        // set negative deformation
+                        ice.ras[y][x] = zero_elev.ras[y][x];                      // set new ice elevation
                     } else {
-                        n_ice.ras[y][x] = surf.ras[y][x];                         // set new ice elevation
+                        ice.ras[y][x] = surf.ras[y][x];                           // set new ice elevation
                     }
                     
                     // calculate the new ice load at posting points
-                    n_iceload.ras[y][x] = (w_wgt * iceload.ras[y][iceload.b.w1[x]]) + (t_wgt * iceload.ras[y][x]);
-                }
-            }
-            
-            // change the ice and ice_load rasters after we have calculated new values
-            for (int y = 0; y < sim.ydim; y++) {
-                for (int x = 0; x < sim.xdim; x++) {
-                    ice.ras[y][x] = n_ice.ras[y][x];
-                    iceload.ras[y][x] = n_iceload.ras[y][x];            
+                    iceload.ras[y][x] = (w_wgt * iceload_w) + (t_wgt * iceload_t);
+                    
+                    // the old target values are the west values for the next cell
+                    ice_w = ice_t;
+                    iceload_w = iceload_t;
                 }
             }
         }
         
-        void calc_basal_pres (int y, int x) {
+        template <class sv>
+        void calc_basal_pres (sv & v, int y, int x) {
             /* method to calculate the basal pres at a specific site and assign contact raster
             Note that the basal deformation must be properly assigned. 
+            v = the view of the squish values (see stab_squish.hpp)
             y = the target y coordinate
             x = the target x coordinate
             */
             
-            basal_pres.ras[y][x] = cell_avg_global_bf + ((basal_def.ras[y][x] / sim.len_timestep) * sim.viscosity);
-            if (basal_pres.ras[y][x] - basal_pres_fudge < 0.0) {
-                basal_pres.ras[y][x] = 0.0;                 // cavity
-                contact.ras[y][x] = 0.0;                    // cavity
+            v.basal_pres(y, x) = cell_avg_global_bf + ((v.basal_def(y, x) / sim.len_timestep) * sim.viscosity);
+            if (v.basal_pres(y, x) - basal_pres_fudge < 0.0) {
+                v.basal_pres(y, x) = 0.0;                   // cavity
+                v.contact(y, x) = 0;                        // cavity
             } else {
-                contact.ras[y][x] = 1.0;                    // contact with bed
+                v.contact(y, x) = 1;                        // contact with bed
             }
         }    
+        
+        squish_soa_view soa_view () {
+            /* method to return a view of the squish values held in the engine rasters
+            */
+            return (squish_soa_view (surf, bsmt, ice, basal_def, basal_pres, contact, zero_elev));
+        }
+        
+        #ifdef STAB_SQUISH_AOS
+        void pack_squish_cells () {
+            /* method to gather the squish values from the engine rasters into the interleaved
+            squish records. This is a straight sweep down the rows, a band per thread.
+            */
+            th.run (sim.ydim, [&] (int y0, int y1, int) {
+                pack_squish_rows (y0, y1);
+            });
+        }
+        
+        void pack_squish_rows (int y0, int y1) {
+            // method to gather the squish values of rows y0 to y1 - 1 into the squish records
+            for (int y = y0; y < y1; y++) {
+                for (int x = 0; x < sim.xdim; x++) {
+                    squish_cell & c = sq_cells (y, x);
+                    c.surf = surf.ras[y][x];
+                    c.bsmt = bsmt.ras[y][x];
+                    c.ice = ice.ras[y][x];
+                    c.basal_def = basal_def.ras[y][x];
+                    c.basal_pres = basal_pres.ras[y][x];
+                    c.contact = contact.ras[y][x];
+                    c.zero_elev = zero_elev.ras[y][x];
+                }
+            }
+        }
+        
+        void unpack_squish_cells () {
+            /* method to scatter the squish records back to the engine rasters. Only the values
+            that the squish modifies are written back (bsmt and zero_elev are read only).
+            */
+            th.run (sim.ydim, [&] (int y0, int y1, int) {
+                unpack_squish_rows (y0, y1);
+            });
+        }
+        
+        void unpack_squish_rows (int y0, int y1) {
+            // method to scatter the squish records of rows y0 to y1 - 1 back to the engine rasters
+            for (int y = y0; y < y1; y++) {
+                for (int x = 0; x < sim.xdim; x++) {
+                    squish_cell & c = sq_cells (y, x);
+                    surf.ras[y][x] = c.surf;
+                    ice.ras[y][x] = c.ice;
+                    basal_def.ras[y][x] = c.basal_def;
+                    basal_pres.ras[y][x] = c.basal_pres;
+                    contact.ras[y][x] = c.contact;
+                }
+            }
+        }
+        #endif
 
         void squish_sediment () {
             /* method to squish sediment based on the pressure gradients set up by the move_ice call. This
@@ -343,6 +1083,302 @@ class stab {
             pressure. This is done randomly without replacement, ensuring every cell is visited. This
             must be done randomly to avoid the intractible infinite dependencies that can occur where the advection
             has to be limited by nonlinearities in the constraints (e.g., basement or hit ice situations).
+            
+            The squish runs against the rasters directly, or against the interleaved squish records if
+            compiled with STAB_SQUISH_AOS (see stab_squish.hpp). With the simfile squish key set to
+            'colored' the polls are split into sets that can be squished in parallel (see squish_sets).
+            With the squish key set to 'jacobi' the random order is replaced by two passes over all
+            the cells (see squish_two_pass), which is a different (approximate) algorithm.
+            */
+            
+            if (!squish_jacobi) {
+                p.calc_new_sequence (rng, t, stream_poll);  // calculate new random sequence of polls
+            }
+            double start_time = wall_clock ();
+            
+            #ifdef STAB_SQUISH_AOS
+            pack_squish_cells ();
+            squish_view v (sq_cells);
+            #else
+            squish_view v = soa_view ();
+            #endif
+            
+            if (squish_colored) {
+                squish_sets (v);
+            } else if (squish_jacobi) {
+                squish_two_pass (v);
+            } else {
+                sq_logs[0].reset ();
+                (this->*squish_polls) (v, p.ys, p.xs, 0, p.len, sq_logs[0]);
+                sl.add_fluxes (sq_logs[0]);
+            }
+            
+            #ifdef STAB_SQUISH_AOS
+            unpack_squish_cells ();
+            #endif
+            
+            squish_time = squish_time + (wall_clock () - start_time);
+        }
+        
+        void squish_sets (squish_view & v) {
+            /* method to squish the polls in parallel. A poll reads and writes its cell and the four
+            neighbours (the 5 point stencil), so two polls can run at the same time if their stencils
+            do not overlap. The polls are split into sets (see color_polls_sets) such that no two
+            polls in a set overlap, and every poll comes after the earlier polls (in the sequence) that
+            it overlaps. The sets are then squished in order, a set at a time, with the polls of a
+            set split into chunks over the threads. Polls that do not overlap give the same result in
+            either order, so this gives the same rasters as the random squish, whatever the number of
+            threads. The log sums are kept for each chunk and added in order, so these do not depend
+            on the number of threads either (they can differ from the random squish by rounding).
+            v = the view of the squish values (see stab_squish.hpp)
+            */
+            (this->*color_polls) ();
+            
+            for (size_t s = 0; s + 1 < sq_set_start.size (); s++) {
+                size_t first = sq_set_start[s];
+                size_t end = sq_set_start[s + 1];
+                int chunks = (int)(((end - first) + squish_chunk - 1) / squish_chunk);
+                
+                th.run (chunks, [&] (int c0, int c1, int) {
+                    for (int c = c0; c < c1; c++) {
+                        size_t i0 = first + ((size_t)c * squish_chunk);
+                        size_t i1 = (i0 + squish_chunk < end) ? (i0 + squish_chunk) : end;
+                        sq_logs[c].reset ();
+                        (this->*squish_polls) (v, sq_ys, sq_xs, i0, i1, sq_logs[c]);
+                    }
+                });
+                for (int c = 0; c < chunks; c++) {
+                    sl.add_fluxes (sq_logs[c]);
+                }
+            }
+        }
+        
+        void squish_two_pass (squish_view & v) {
+            /* method to squish all the cells at once, in two passes (a Jacobi style update, where the
+            random squish is Gauss-Seidel style). The first pass works out the squish from each cell
+            in contact to its four neighbours from the values at the start of the squish, with the
+            same basement and zero_elev limits as the random squish, and keeps these in sq_flux (see
+            squish_flux_rows). The second pass takes the squish out of each cell and gathers in the
+            squish from its neighbours (see squish_gather_rows). A cell only writes its own values in
+            each pass, so both passes run a band of rows per thread with no ordering and the results
+            do not depend on the number of threads. The squish is not the same as the random squish:
+            the cells all see the pressures from before the squish, so the bedforms differ (see
+            validate.py).
+            v = the view of the squish values (see stab_squish.hpp)
+            */
+            sweep ([&] (int y0, int y1, stab_band &) {
+                (this->*sq_flux_rows) (v, y0, y1, row_logs);
+            });
+            sweep ([&] (int y0, int y1, stab_band &) {
+                (this->*sq_gather_rows) (v, y0, y1);
+            });
+        }
+        
+        template <class sv, bool periodic_ns, bool periodic_ew>
+        void squish_flux_rows (sv & v, int y0, int y1, stab_flux_log * logs) {
+            /* method to run the first pass of the two pass squish on rows y0 to y1 - 1: the squish
+            from each cell, and the squish off nonperiodic edges (see squish_two_pass). This reads
+            the rows y0 - 1 to y1, and writes sq_flux in the rows.
+            v = the view of the squish values (see stab_squish.hpp)
+            logs = the log sums of each row
+            periodic_ns, periodic_ew = the boundary types (see select_kernels)
+            */
+            int ydim = sim.ydim;
+            int xdim = sim.xdim;
+            typedef tb_edge <periodic_ns> edge_ns;
+            typedef tb_edge <periodic_ew> edge_ew;
+            
+            for (int y = y0; y < y1; y++) {
+                stab_flux_log & fl = logs[y];
+                for (int x = 0; x < xdim; x++) {
+                    stab_sq_flux & f = sq_flux[((size_t)y * xdim) + x];
+                    if (v.contact(y, x) == 1) {
+                        calc_sq_fluxes <sv, periodic_ns, periodic_ew> (v, y, x, f.n, f.s, f.e, f.w, 0.25);
+                        
+                        if (f.n > 0.0 && edge_ns::is_toxic (edge_ns::fwd_move (y, ydim))) {
+                            fl.total_bleed = fl.total_bleed + f.n;
+                        }
+                        if (f.s > 0.0 && edge_ns::is_toxic (edge_ns::back_move (y, ydim))) {
+                            fl.total_bleed = fl.total_bleed + f.s;
+                        }
+                        if (f.e > 0.0 && edge_ew::is_toxic (edge_ew::fwd_move (x, xdim))) {
+                            fl.total_bleed = fl.total_bleed + f.e;
+                        }
+                        if (f.w > 0.0 && edge_ew::is_toxic (edge_ew::back_move (x, xdim))) {
+                            fl.total_bleed = fl.total_bleed + f.w;
+                        }
+                        
+                        fl.Q_sq_n = fl.Q_sq_n + f.n;                 // log the advection to the n
+                        fl.Q_sq_s = fl.Q_sq_s + f.s;                 // log the advection to the s
+                        fl.Q_sq_e = fl.Q_sq_e + f.e;                 // log the advection to the e
+                        fl.Q_sq_w = fl.Q_sq_w + f.w;                 // log the advection to the w
+                    } else {
+                        f = stab_sq_flux ();
+                    }
+                }
+            }
+        }
+        
+        template <class sv, bool periodic_ns, bool periodic_ew>
+        void squish_gather_rows (sv & v, int y0, int y1) {
+            /* method to run the second pass of the two pass squish on rows y0 to y1 - 1: take the
+            squish out of each cell, then gather in the squish of the neighbours (see
+            squish_two_pass). This reads sq_flux in the rows y0 - 1 to y1, and writes the cells of
+            the rows.
+            v = the view of the squish values (see stab_squish.hpp)
+            periodic_ns, periodic_ew = the boundary types (see select_kernels)
+            */
+            int ydim = sim.ydim;
+            int xdim = sim.xdim;
+            typedef tb_edge <periodic_ns> edge_ns;
+            typedef tb_edge <periodic_ew> edge_ew;
+            
+            for (int y = y0; y < y1; y++) {
+                int yn = edge_ns::fwd_move (y, ydim);
+                int ys = edge_ns::back_move (y, ydim);
+                for (int x = 0; x < xdim; x++) {
+                    int xe = edge_ew::fwd_move (x, xdim);
+                    int xw = edge_ew::back_move (x, xdim);
+                    const stab_sq_flux & f = sq_flux[((size_t)y * xdim) + x];
+                    double Q_in = 0.0;              // squish gathered from the neighbours
+                    
+                    if (v.contact(y, x) == 1) {
+                        double req_ero = f.n + f.s + f.e + f.w;
+                        v.surf(y, x) = v.surf(y, x) - req_ero;                  // lower target cell
+                        v.basal_def(y, x) = v.basal_def(y, x) - req_ero;        // reduce basal deformation
+                        v.ice(y, x) = v.surf(y, x);                             // ice is re-assigned to maintain contact
+                        calc_basal_pres (v, y, x);                              // re-calculate basal pres
+                    }
+                    
+                    if (!edge_ns::is_toxic (ys)) {
+                        Q_in = Q_in + sq_flux[((size_t)ys * xdim) + x].n;      // from the s, to the n
+                    }
+                    if (!edge_ns::is_toxic (yn)) {
+                        Q_in = Q_in + sq_flux[((size_t)yn * xdim) + x].s;      // from the n, to the s
+                    }
+                    if (!edge_ew::is_toxic (xw)) {
+                        Q_in = Q_in + sq_flux[((size_t)y * xdim) + xw].e;      // from the w, to the e
+                    }
+                    if (!edge_ew::is_toxic (xe)) {
+                        Q_in = Q_in + sq_flux[((size_t)y * xdim) + xe].w;      // from the e, to the w
+                    }
+                    gather_sq_sed (v, y, x, Q_in);
+                }
+            }
+        }
+        
+        template <class sv>
+        void gather_sq_sed (sv & v, int y, int x, double Q) {
+            /* method to deposit the squish gathered from the neighbours of a cell (see
+            squish_two_pass). This is deposit_sq_sed, except that a cavity can be sent more
+            than it holds (each neighbour only knows the cavity size before the squish), so a cavity
+            that fills passes the rest on as a deposit onto a cell in contact, rather than losing it.
+            v = the view of the squish values (see stab_squish.hpp)
+            y = the deposition site y coordinate
+            x = the deposition site x coordinate
+            Q = the increase in raster cell (deposition)
+            */
+            
+            double over;                    // deposit above the ice
+            
+            if (Q > 0.0) {
+                v.surf(y, x) = v.surf(y, x) + Q;
+                
+                // check if depositing into a cavity
+                if (v.contact(y, x) == 0) {
+                    // check to see if we are depositing up to the ice level
+                    if ((v.surf(y, x) + 0.0000000001) > v.ice(y, x)) {
+                        over = v.surf(y, x) - v.ice(y, x);
+                        if (over > 0.0) {
+                            v.ice(y, x) = v.surf(y, x);             // ice is pushed upwards
+                            v.basal_def(y, x) = v.basal_def(y, x) + over;
+                        } else {
+                            v.surf(y, x) = v.ice(y, x);             // address minor rounding error
+                        }
+                        v.contact(y, x) = 1;                        // set contact
+                    }
+                } else {
+                    // we are depositing into an area in contact with the ice
+                    v.ice(y, x) = v.surf(y, x);                     // ice is pushed upwards
+                    v.basal_def(y, x) = v.basal_def(y, x) + Q;      // basal deformation increased
+                }
+                // recalculate the basal pres
+                calc_basal_pres (v, y, x);
+            }
+        }
+        
+        template <bool periodic_ns, bool periodic_ew>
+        void color_polls_sets () {
+            /* method to split the present poll sequence into squish sets (see squish_sets). Two polls
+            overlap if their cells are within 2 cells of each other (counting steps north-south and
+            east-west). Working through the sequence, a poll goes in the set after the last set of the
+            earlier polls it overlaps, so the set of each cell is the longest chain of overlapping
+            polls leading up to it. This is a random (Jones-Plassmann style) colouring, with the
+            random sequence as the priorities. The polls are then sorted into sq_ys and sq_xs by set,
+            keeping their order in the sequence.
+            periodic_ns, periodic_ew = the boundary types, overlaps wrap around periodic edges
+            */
+            typedef tb_edge <periodic_ns> edge_ns;
+            typedef tb_edge <periodic_ew> edge_ew;
+            static const int n_near = 12;
+            static const int near_y[n_near] = {-2, -1, -1, -1, 0, 0, 0, 0, 1, 1, 1, 2};
+            static const int near_x[n_near] = {0, -1, 0, 1, -2, -1, 1, 2, -1, 0, 1, 0};
+            int ydim = sim.ydim;
+            int xdim = sim.xdim;
+            int y, x, yn, xn;               // the poll, and a nearby cell
+            int top;                        // the last set (plus 1) of the earlier overlapping polls
+            vector <size_t> next;           // the next position in each set
+            
+            th.run (ydim, [&] (int y0, int y1, int) {
+                memset (sq_set + ((size_t)y0 * xdim), 0, (size_t)(y1 - y0) * xdim * sizeof (uint16_t));
+            });
+            
+            sq_set_start.assign (1, 0);
+            for (size_t i = 0; i < p.len; i++) {
+                y = p.ys[i];
+                x = p.xs[i];
+                top = 0;
+                for (int k = 0; k < n_near; k++) {
+                    yn = edge_ns::shift (y, near_y[k], ydim);
+                    xn = edge_ew::shift (x, near_x[k], xdim);
+                    if (!edge_ns::is_toxic (yn) && !edge_ew::is_toxic (xn)) {
+                        top = max (top, (int)sq_set[((size_t)yn * xdim) + xn]);
+                    }
+                }
+                if (top == 0xffff) {
+                    cout << "ERROR: too many squish sets" << endl;
+                    exit (10);
+                }
+                sq_set[((size_t)y * xdim) + x] = (uint16_t)(top + 1);
+                if ((int)sq_set_start.size () <= top + 1) {
+                    sq_set_start.push_back (0);
+                }
+                sq_set_start[top + 1]++;            // count the polls in the set
+            }
+            
+            // turn the counts into the first poll of each set, and sort the polls
+            for (size_t s = 1; s < sq_set_start.size (); s++) {
+                sq_set_start[s] = sq_set_start[s] + sq_set_start[s - 1];
+            }
+            next.assign (sq_set_start.begin (), sq_set_start.end () - 1);
+            for (size_t i = 0; i < p.len; i++) {
+                y = p.ys[i];
+                x = p.xs[i];
+                size_t & n = next[sq_set[((size_t)y * xdim) + x] - 1];
+                sq_ys[n] = y;
+                sq_xs[n] = x;
+                n++;
+            }
+        }
+        
+        template <class sv, bool periodic_ns, bool periodic_ew>
+        void squish_sediment_polls (sv & v, const int * ys, const int * xs, size_t i0, size_t i1, stab_flux_log & fl) {
+            /* method to run the squish over polls i0 up to i1 of a poll sequence
+            v = the view of the squish values (see stab_squish.hpp)
+            periodic_ns, periodic_ew = the boundary types (see select_kernels)
+            ys, xs = the poll sequence (the tb_poll lists, or a squish set, see squish_sets)
+            i0, i1 = the polls to run
+            fl = the log sums
             */
             
             double Q_sq_n;                  // squish to the north
@@ -351,123 +1387,164 @@ class stab {
             double Q_sq_w;                  // squish to the west
             
             double req_ero;                 // requested erosion
-            double av_sed;                  // available sediment
-            double reduce_frac;             // reduce fraction
 
             int y;                          // the y coordinate
             int x;                          // the x coordinate
+            
+            int ydim = sim.ydim;
+            int xdim = sim.xdim;
+            typedef tb_edge <periodic_ns> edge_ns;
+            typedef tb_edge <periodic_ew> edge_ew;
 
-            p.calc_new_sequence ();         // calculate new random sequence of polls
-
-            for (int i = 0; i < p.len; i++) {
-                y = p.ys[i];                // get target y
-                x = p.xs[i];                // get target x
+            for (size_t i = i0; i < i1; i++) {
+                y = ys[i];                  // get target y
+                x = xs[i];                  // get target x
 
                 // check for contact of the target cell, no contact no basal pres and no squish
-                if (contact.ras[y][x] == 1.0) {
-                    
-                    // calculate the squish potential
-                    Q_sq_n = calc_sq_potential (y, x, surf.b.n1[y], x);
-                    Q_sq_s = calc_sq_potential (y, x, surf.b.s1[y], x);
-                    Q_sq_e = calc_sq_potential (y, x, y, surf.b.e1[x]);
-                    Q_sq_w = calc_sq_potential (y, x, y, surf.b.w1[x]);
-                    
-                    // check for basement erosion, and adjust the erosion if necessary
-                    req_ero = Q_sq_n + Q_sq_s + Q_sq_e + Q_sq_w;            // calculate requested erosion
-                    if (((surf.ras[y][x] - req_ero) < bsmt.ras[y][x]) && (req_ero != 0.0)) {
-                        av_sed = surf.ras[y][x] - bsmt.ras[y][x];
-                        reduce_frac = av_sed / req_ero;
-                        Q_sq_n = Q_sq_n * reduce_frac;
-                        Q_sq_s = Q_sq_s * reduce_frac;
-                        Q_sq_e = Q_sq_e * reduce_frac;
-                        Q_sq_w = Q_sq_w * reduce_frac;
-                        req_ero = Q_sq_n + Q_sq_s + Q_sq_e + Q_sq_w;        // recalculate requested erosion
-                    }
+                if (v.contact(y, x) == 1) {
                     
-                    // check for possibility of squish beyond ice elevation
-                    if (((surf.ras[y][x] - req_ero) < zero_elev.ras[y][x]) && (req_ero != 0.0)) {
-                        // we are going to erode too deeply, we must reduce sed transfer
-                        reduce_frac = (surf.ras[y][x] - zero_elev.ras[y][x]) / req_ero;
-                        
-                        // address the problem whereby the surf raster is slightly below the zero elev
-                        // and the reduce frac becomes very slightly negative, which screws up the mass balance
-                        if (reduce_frac < 0.0) {
-                            reduce_frac = reduce_frac * -1.0;
-                        }
-                        // also check for errors with reduce fracs that are greater than one
-                        // this should not occur, but has happened with amplification of math errors.
-                        if (reduce_frac > 1.0) {
-                            cout << "ERROR: reduce frac > 1.0" << endl;
-                            exit (10);
-                        }
-                        
-                        Q_sq_n = Q_sq_n * reduce_frac;
-                        Q_sq_s = Q_sq_s * reduce_frac;
-                        Q_sq_e = Q_sq_e * reduce_frac;
-                        Q_sq_w = Q_sq_w * reduce_frac;
-                        req_ero = Q_sq_n + Q_sq_s + Q_sq_e + Q_sq_w;        // recalculate requested erosion
-                    }
+                    // calculate the squish potential, limited by the basement and the ice
+                    req_ero = calc_sq_fluxes <sv, periodic_ns, periodic_ew> (v, y, x, Q_sq_n, Q_sq_s, Q_sq_e, Q_sq_w);
 
-                    surf.ras[y][x] = surf.ras[y][x] - req_ero;              // lower target cell
-                    basal_def.ras[y][x] = basal_def.ras[y][x] - req_ero;    // reduce basal deformation
-                    ice.ras[y][x] = surf.ras[y][x];                         // ice is re-assigned to maintain contact
-                    calc_basal_pres (y, x);                                 // re-calculate basal pres
+                    v.surf(y, x) = v.surf(y, x) - req_ero;                  // lower target cell
+                    v.basal_def(y, x) = v.basal_def(y, x) - req_ero;        // reduce basal deformation
+                    v.ice(y, x) = v.surf(y, x);                             // ice is re-assigned to maintain contact
+                    calc_basal_pres (v, y, x);                              // re-calculate basal pres
                     
-                    deposit_sq_sed (surf.b.n1m[y], x, Q_sq_n);              // deposit to the n
-                    deposit_sq_sed (surf.b.s1m[y], x, Q_sq_s);              // deposit to the s
-                    deposit_sq_sed (y, surf.b.e1m[x], Q_sq_e);              // deposit to the e
-                    deposit_sq_sed (y, surf.b.w1m[x], Q_sq_w);              // deposit to the w
+                    deposit_sq_sed <sv, periodic_ns, periodic_ew> (v, edge_ns::fwd_move (y, ydim), x, Q_sq_n, fl);   // deposit to the n
+                    deposit_sq_sed <sv, periodic_ns, periodic_ew> (v, edge_ns::back_move (y, ydim), x, Q_sq_s, fl);  // deposit to the s
+                    deposit_sq_sed <sv, periodic_ns, periodic_ew> (v, y, edge_ew::fwd_move (x, xdim), Q_sq_e, fl);   // deposit to the e
+                    deposit_sq_sed <sv, periodic_ns, periodic_ew> (v, y, edge_ew::back_move (x, xdim), Q_sq_w, fl);  // deposit to the w
                     
-                    sl.Q_sq_n = sl.Q_sq_n + Q_sq_n;                         // log the advection to the n
-                    sl.Q_sq_s = sl.Q_sq_s + Q_sq_s;                         // log the advection to the s
-                    sl.Q_sq_e = sl.Q_sq_e + Q_sq_e;                         // log the advection to the e
-                    sl.Q_sq_w = sl.Q_sq_w + Q_sq_w;                         // log the advection to the w
+                    fl.Q_sq_n = fl.Q_sq_n + Q_sq_n;                         // log the advection to the n
+                    fl.Q_sq_s = fl.Q_sq_s + Q_sq_s;                         // log the advection to the s
+                    fl.Q_sq_e = fl.Q_sq_e + Q_sq_e;                         // log the advection to the e
+                    fl.Q_sq_w = fl.Q_sq_w + Q_sq_w;                         // log the advection to the w
+                }
+            }
+        }
+        
+        template <class sv, bool periodic_ns, bool periodic_ew>
+        double calc_sq_fluxes (sv & v, int y, int x, double & Q_sq_n, double & Q_sq_s, double & Q_sq_e, double & Q_sq_w,
+                               double cavity_share = 1.0) {
+            /* method to calculate the squish from a cell in contact to each neighbour, limited so the
+            cell is not eroded below the basement or the elevation of zero basal pres. Returns the
+            requested erosion (the sum of the fluxes).
+            v = the view of the squish values (see stab_squish.hpp)
+            periodic_ns, periodic_ew = the boundary types (see select_kernels)
+            y = the target y coordinate
+            x = the target x coordinate
+            Q_sq_n, Q_sq_s, Q_sq_e, Q_sq_w = the squish to the north, south, east and west
+            cavity_share = the share of a neighbouring cavity this cell may fill (see calc_sq_potential)
+            */
+            
+            double req_ero;                 // requested erosion
+            double av_sed;                  // available sediment
+            double reduce_frac;             // reduce fraction
+            
+            typedef tb_edge <periodic_ns> edge_ns;
+            typedef tb_edge <periodic_ew> edge_ew;
+            
+            // calculate the squish potential
+            Q_sq_n = calc_sq_potential (v, y, x, edge_ns::fwd (y, sim.ydim), x, cavity_share);
+            Q_sq_s = calc_sq_potential (v, y, x, edge_ns::back (y, sim.ydim), x, cavity_share);
+            Q_sq_e = calc_sq_potential (v, y, x, y, edge_ew::fwd (x, sim.xdim), cavity_share);
+            Q_sq_w = calc_sq_potential (v, y, x, y, edge_ew::back (x, sim.xdim), cavity_share);
+            
+            // check for basement erosion, and adjust the erosion if necessary
+            req_ero = Q_sq_n + Q_sq_s + Q_sq_e + Q_sq_w;            // calculate requested erosion
+            if (((v.surf(y, x) - req_ero) < v.bsmt(y, x)) && (req_ero != 0.0)) {
+                av_sed = (double)v.surf(y, x) - v.bsmt(y, x);      // in double, as the test above (see STAB_FLOAT)
+                reduce_frac = av_sed / req_ero;
+                Q_sq_n = Q_sq_n * reduce_frac;
+                Q_sq_s = Q_sq_s * reduce_frac;
+                Q_sq_e = Q_sq_e * reduce_frac;
+                Q_sq_w = Q_sq_w * reduce_frac;
+                req_ero = Q_sq_n + Q_sq_s + Q_sq_e + Q_sq_w;        // recalculate requested erosion
+            }
+            
+            // check for possibility of squish beyond ice elevation
+            if (((v.surf(y, x) - req_ero) < v.zero_elev(y, x)) && (req_ero != 0.0)) {
+                // we are going to erode too deeply, we must reduce sed transfer
+                reduce_frac = ((double)v.surf(y, x) - v.zero_elev(y, x)) / req_ero;
+                
+                // address the problem whereby the surf raster is slightly below the zero elev
+                // and the reduce frac becomes very slightly negative, which screws up the mass balance
+                if (reduce_frac < 0.0) {
+                    reduce_frac = reduce_frac * -1.0;
+                }
+                // also check for errors with reduce fracs that are greater than one
+                // this should not occur, but has happened with amplification of math errors. If the surf
+                // is within the rounding of a stored elevation of the zero elev (e.g., with float state
+                // rasters, see STAB_FLOAT), this is rounding, and the reduce frac is limited to 1.
+                if (reduce_frac > 1.0) {
+                    if (fabs ((double)v.surf(y, x) - v.zero_elev(y, x)) <= 4.0 * numeric_limits <stab_real>::epsilon () * fabs (v.zero_elev(y, x))) {
+                        reduce_frac = 1.0;
+                    } else {
+                        cout << "ERROR: reduce frac > 1.0" << endl;
+                        exit (10);
+                    }
                 }
+                
+                Q_sq_n = Q_sq_n * reduce_frac;
+                Q_sq_s = Q_sq_s * reduce_frac;
+                Q_sq_e = Q_sq_e * reduce_frac;
+                Q_sq_w = Q_sq_w * reduce_frac;
+                req_ero = Q_sq_n + Q_sq_s + Q_sq_e + Q_sq_w;        // recalculate requested erosion
             }
+            return (req_ero);
         }
         
-        void deposit_sq_sed (int y, int x, double Q) {
+        template <class sv, bool periodic_ns, bool periodic_ew>
+        void deposit_sq_sed (sv & v, int y, int x, double Q, stab_flux_log & fl) {
             /* deposit sediment at a site
             Arguments:
+            v = the view of the squish values (see stab_squish.hpp)
+            periodic_ns, periodic_ew = the boundary types, the toxic tests compile away if periodic
             y = the deposition site y coordinate
             x = the deposition site x coordinate
             Q = the increase in raster cell (deposition)
+            fl = the log sums (for the bleed)
             */
             
             if (Q > 0.0) {
-                if (y != surf.b.toxic_coord && x != surf.b.toxic_coord) {
-                    surf.ras[y][x] = surf.ras[y][x] + Q;
+                if (!tb_edge <periodic_ns>::is_toxic (y) && !tb_edge <periodic_ew>::is_toxic (x)) {
+                    v.surf(y, x) = v.surf(y, x) + Q;
 
                     // check if depositing into a cavity
-                    if (contact.ras[y][x] == 0.0) {
+                    if (v.contact(y, x) == 0) {
                         // check to see if we are depositing up to the ice level
-                        if ((surf.ras[y][x] + 0.0000000001) > ice.ras[y][x]) {
-                            surf.ras[y][x] = ice.ras[y][x];         // address minor rounding error
-                            contact.ras[y][x] = 1.0;                // set contact
+                        if ((v.surf(y, x) + 0.0000000001) > v.ice(y, x)) {
+                            v.surf(y, x) = v.ice(y, x);         // address minor rounding error
+                            v.contact(y, x) = 1;                // set contact
                         } else {
                             // we are not depositing up to ice level, just infilling cavity a bit
-                            contact.ras[y][x] = 0.0;
+                            v.contact(y, x) = 0;
                         }
                     } else {
                         // we are depositing into an area in contact with the ice
-                        ice.ras[y][x] = surf.ras[y][x];                     // ice is pushed upwards
-                        basal_def.ras[y][x] = basal_def.ras[y][x] + Q;      // basal deformation increased
+                        v.ice(y, x) = v.surf(y, x);                     // ice is pushed upwards
+                        v.basal_def(y, x) = v.basal_def(y, x) + Q;      // basal deformation increased
                     }
                     // recalculate the basal pres
-                    calc_basal_pres (y, x);
+                    calc_basal_pres (v, y, x);
                 } else {
-                    sl.total_bleed = sl.total_bleed + Q;
+                    fl.total_bleed = fl.total_bleed + Q;
                 }
             }
         }    
 
-        double calc_sq_potential (int y, int x, int y_t, int x_t) {
+        template <class sv>
+        double calc_sq_potential (sv & v, int y, int x, int y_t, int x_t, double cavity_share = 1.0) {
             /* method to calculate the maximum potential squish potential to an adjacent cell
             Arguments:
+            v = the view of the squish values (see stab_squish.hpp)
             y = the target y coordinate
             x = the target x coordinate
             y_t = the test y coordinate
             x_t = the test x coordinate
+            cavity_share = the share of the cavity at the test cell that can be filled (1 unless the
+                neighbours of the cavity all squish into it at once, see squish_two_pass)
             */
             
             double df_dx;                               // pres gradient
@@ -475,7 +1552,7 @@ class stab {
             double max_Q_sq;                            // maximum Q squish
             
             // calculate basal pres gradient
-            df_dx = (basal_pres.ras[y][x] - basal_pres.ras[y_t][x_t]) / basal_pres.cellsize;
+            df_dx = (v.basal_pres(y, x) - v.basal_pres(y_t, x_t)) / sim.cellsize;
             
             // calculate the prospective flux
             if (df_dx > 0.0) {
@@ -483,12 +1560,12 @@ class stab {
                 Q_sq = df_dx * sim.len_timestep * sim.Q_squish_coef;        // prospective flux
 
                 // check for contact with the target cell
-                if (contact.ras[y_t][x_t] == 1.0) {
+                if (v.contact(y_t, x_t) == 1) {
                     // assign limitation based on pressure equalization
-                    max_Q_sq = 0.125 * (basal_def.ras[y][x] - basal_def.ras[y_t][x_t]);
+                    max_Q_sq = 0.125 * (v.basal_def(y, x) - v.basal_def(y_t, x_t));
                 } else {
                     // assign limitation based on cavity size
-                    max_Q_sq = ice.ras[y_t][x_t] - surf.ras[y_t][x_t];
+                    max_Q_sq = (v.ice(y_t, x_t) - v.surf(y_t, x_t)) * cavity_share;
                 }
                 
                 if (Q_sq > max_Q_sq) {
@@ -500,74 +1577,171 @@ class stab {
             return (Q_sq);
         }
 
-        void advect_entrainment () {
-            /* method to advect and entrain sediment from the raster. This function
-            calculates the requested entrainment and advection from a site and determines
-            if this will erode all the sediment at a site. If so, the erosion is limited.
+        template <bool erosion, bool bleed_surf, bool bleed_iceload, bool bleed_diffusive>
+        void advect_erode_sediment () {
+            /* method to advect and entrain sediment, erode the basement, apply the changes to the
+            surface and iceload rasters, and bleed the surface and the iceload, in one sweep down the
+            rows. Each of these only touches cells in its own row (advection moves sediment one cell
+            east), so the rows are done a band per thread (see sweep), a row at a time with the
+            kernel picked for the boundaries and processes (see post_squish_row_cells).
+            
+            erosion, bleed_surf, bleed_iceload, bleed_diffusive = the active processes (see run_step)
+            */
+            
+            basal_pres.refresh_halo ();         // east neighbour for calc_advection is x + 1
+            
+            sweep ([&] (int y0, int y1, stab_band & b) {
+                for (int y = y0; y < y1; y++) {
+                    (this->*post_squish_row) (y, b);    // row kernel for the boundaries and processes (see select_row_kernel)
+                }
+            });
+        }
+        
+        template <bool periodic_ew, bool stochastic, bool erosion, bool bleed_surf, bool bleed_iceload, bool bleed_diffusive>
+        void post_squish_row_cells (int y, stab_band & b) {
+            /* method to advect and entrain sediment, erode the basement, apply the changes, and bleed
+            the surface and iceload, across a row. This is done a cell at a time, working east:
+            
+            1. the advection and entrainment of the cell (calc_advection_entrainment)
+            2. the basement erosion of the cell (erode_basement_cell)
+            3. the cell gains the advection from the west cell, and loses its own advection and
+               entrainment (the advection from the west is carried along from the last cell)
+            4. the surface and iceload bleeds of the cell (surf_bleed_cell, iceload_bleed_cell)
+            
+            The advection of a cell only reads the cell and the basal pres to the east (which does
+            not change in the sweep), so this gives the same rasters and log sums as running each of
+            these over the whole grid in turn. The changes are rounded to stab_real as they were in
+            the rows of pending changes this replaces. Sediment advected off the east edge is worked
+            out before the sweep, so it can be added to the west edge cell (periodic) or logged as
+            bleed (nonperiodic). The basal_pres halo must be current.
+            
+            The random draws for the stochasticity are taken for the whole row up front, word
+            (y * xdim) + x of the advection stream for cell x (see tb_philox), with the vector
+            generator if the vector kernels are active.
+            
+            periodic_ew, stochastic = the boundary and flux types (see select_row_kernel)
+            erosion, bleed_surf, bleed_iceload, bleed_diffusive = the active processes (see run_step)
+            y = the row to sweep
+            b = the working space of the thread
             */
             
-            dsurf.setvalue (0.0);               // reset dsurf raster
-            diceload.setvalue (0.0);            // set the iceload value
+            uint64_t n0 = (uint64_t)y * sim.xdim;          // first random word of the row
+            stab_flux_log & fl = row_logs[y];
+            
+            #ifdef STAB_SIMD
+            if (simd_active) {
+                if (stochastic) {
+                    simd.random_row (b.sg, rng, post_t, stream_advection, n0);
+                }
+                simd.post_squish_row (b.sg, y, stochastic, periodic_ew, erosion, bleed_surf, bleed_iceload, bleed_diffusive, fl);
+                return;
+            }
+            #endif
+            
             double Q_ad;                        // advection flux
             double Q_en;                        // entrainment flux
+            stab_real dsurf;                    // surface change of the cell
+            stab_real diceload;                 // iceload change of the cell
+            stab_real Q_ad_w = 0.0;             // advection into the cell from the west
+            stab_real Q_ad_off;                 // advection off the east edge
+            
+            if (stochastic) {
+                rng.fill (post_t, stream_advection, n0, sim.xdim, b.draws);
+            }
+            
+            // the advection off the east edge lands on the west edge, or bleeds
+            calc_advection_entrainment <stochastic> (y, sim.xdim - 1, b.draws, Q_ad, Q_en);
+            Q_ad_off = Q_ad;
+            if (!periodic_ew) {
+                fl.total_bleed = fl.total_bleed + Q_ad_off;
+            }
+            
+            for (int x = 0; x < sim.xdim; x++) {
+                
+                calc_advection_entrainment <stochastic> (y, x, b.draws, Q_ad, Q_en);
+                
+                // set the changes, with the deposit from the west cell
+                dsurf = Q_ad_w - Q_ad - Q_en;
+                if (periodic_ew && x == 0) {
+                    dsurf = dsurf + Q_ad_off;
+                }
+                diceload = Q_en;
+                Q_ad_w = Q_ad;            // deposit sediment downflow
+                
+                // log fluxes
+                fl.Q_ad = fl.Q_ad + Q_ad;
+                
+                if (Q_en > 0.0) {
+                    fl.Q_entrain = fl.Q_entrain + Q_en;
+                } else {
+                    fl.Q_distrain = fl.Q_distrain + (-1.0 * Q_en);
+                }
+                
+                erode_basement_cell <erosion> (y, x, fl);
+                
+                // apply the changes
+                surf.ras[y][x] = surf.ras[y][x] + dsurf;
+                iceload.ras[y][x] = iceload.ras[y][x] + diceload;
+                
+                if (bleed_surf) {
+                    surf_bleed_cell (y, x, fl);
+                }
+                if (bleed_iceload) {
+                    iceload_bleed_cell <bleed_diffusive> (y, x, fl);
+                }
+            }
+        }
+        
+        template <bool stochastic>
+        void calc_advection_entrainment (int y, int x, const uint32_t * draws, double & Q_ad, double & Q_en) {
+            /* method to calculate the advection and entrainment from a site. This calculates the
+            requested entrainment and advection and determines if this will erode all the sediment
+            at a site. If so, the erosion is limited.
+            stochastic = true if the flux stochasticity is nonzero
+            y = the target y coordinate
+            x = the target x coordinate
+            draws = the random draws for the row (if stochastic)
+            Q_ad = the advection flux
+            Q_en = the entrainment flux (negative for distrainment)
+            */
+            
             double req_ero;                     // set total requested erosion
             double av_sed;                      // available sediment
             double reduce_frac;                 // reduce fraction
             double overdig;                     // potential overdig
             
-            for (int y = 0; y < sim.ydim; y++) {
-                for (int x = 0; x < sim.xdim; x++) {
-                    
-                    Q_ad = calc_advection (y, x);               // calc requested advection
-                    Q_en = calc_entrainment (y, x);             // calc requested entrainment
+            Q_ad = calc_advection <stochastic> (y, x, draws);   // calc requested advection
+            Q_en = calc_entrainment (y, x);                     // calc requested entrainment
 
-                    // set the requested erosion, noting that positive distrainment
-                    // will increase the amount of possible flux.
-                    req_ero = Q_ad + Q_en;
-                    
-                    // check for basement incursion and reduce
-                    if ((surf.ras[y][x] - req_ero) < bsmt.ras[y][x] && req_ero != 0.0) {
-                        av_sed = surf.ras[y][x] - bsmt.ras[y][x];           // available sediment
-                        if (Q_en > 0.0) {
-                            // if we are entraining sediment, reduce both entrainment and advection
-                            reduce_frac = av_sed / req_ero;
-                            Q_ad = reduce_frac * Q_ad;
-                            Q_en = reduce_frac * Q_en;
-                        } else {
-                            // else, we are distraining sediment, only reduce advection
-                            overdig = req_ero - av_sed;             // the requested overdig
-                            Q_ad = Q_ad - overdig;                  // reduce just advection
-                        }
-                    }
- 
-                    // set the dsurf changes
-                    dsurf.ras[y][x] = dsurf.ras[y][x] - Q_ad - Q_en;
-                    diceload.ras[y][x] = diceload.ras[y][x] + Q_en;
-                    
-                    // deposit sediment downflow
-                    if (dsurf.b.e1m[x] != dsurf.b.toxic_coord) {
-                        dsurf.ras[y][dsurf.b.e1m[x]] = dsurf.ras[y][dsurf.b.e1m[x]] + Q_ad;
-                    } else {
-                        sl.total_bleed = sl.total_bleed + Q_ad;
-                    }
-                    
-                    // log fluxes
-                    sl.Q_ad = sl.Q_ad + Q_ad;
-                    
-                    if (Q_en > 0.0) {
-                        sl.Q_entrain = sl.Q_entrain + Q_en;
-                    } else {
-                        sl.Q_distrain = sl.Q_distrain + (-1.0 * Q_en);
-                    }
+            // set the requested erosion, noting that positive distrainment
+            // will increase the amount of possible flux.
+            req_ero = Q_ad + Q_en;
+            
+            // check for basement incursion and reduce
+            if ((surf.ras[y][x] - req_ero) < bsmt.ras[y][x] && req_ero != 0.0) {
+                av_sed = (double)surf.ras[y][x] - bsmt.ras[y][x];   // available sediment (in double, as the test above)
+                if (Q_en > 0.0) {
+                    // if we are entraining sediment, reduce both entrainment and advection
+                    reduce_frac = av_sed / req_ero;
+                    Q_ad = reduce_frac * Q_ad;
+                    Q_en = reduce_frac * Q_en;
+                } else {
+                    // else, we are distraining sediment, only reduce advection
+                    overdig = req_ero - av_sed;             // the requested overdig
+                    Q_ad = Q_ad - overdig;                  // reduce just advection
                 }
             }
         }
         
-        double calc_advection (int y, int x) {
-            /* method to calculate the potential advection for a given site
+        template <bool stochastic>
+        double calc_advection (int y, int x, const uint32_t * draws) {
+            /* method to calculate the potential advection for a given site. Note that this reads
+            the east neighbour through the basal_pres halo, which must be current.
             Arguments:
+            stochastic = true if the flux stochasticity is nonzero
             y = the target y coordinate
             x = the target x coordinate
+            draws = the random draws for the row (if stochastic)
             */
             
             double rep_basal_pres;                 // the representative basal pres
@@ -576,16 +1750,18 @@ class stab {
             // get a representative basal pres for the boundary between this cell and the cell
             // immediately downflow - this is a boundary average basal pres for the couplet (this
             // could be replaced with a basal pres for the cell, but I leave as is for now).
-            rep_basal_pres = (basal_pres.ras[y][x] + basal_pres.ras[y][basal_pres.b.e1[x]]) / 2.0;
+            rep_basal_pres = (basal_pres.ras[y][x] + basal_pres.ras[y][x + 1]) / 2.0;
             
             // set the sediment advection for the site
             if (rep_basal_pres > 0.0) {
                 // calculate sediment flux
                 Q_ad = (rep_basal_pres * sim.Q_advection_global * sim.len_timestep) / sim.cellsize;
-                Q_ad = Q_ad + ((genrand_real1() - 0.5) * Q_ad * sim.Q_advection_stochasticity);
-                
-                if (Q_ad < 0.0) {
-                    Q_ad = 0.0;             // ensure stochasticity doesnt make flux negative
+                if (stochastic) {
+                    Q_ad = Q_ad + ((tb_philox::real1 (draws[x]) - 0.5) * Q_ad * sim.Q_advection_stochasticity);
+                    
+                    if (Q_ad < 0.0) {
+                        Q_ad = 0.0;         // ensure stochasticity doesnt make flux negative
+                    }
                 }
             } else {
                 Q_ad = 0.0;
@@ -604,7 +1780,7 @@ class stab {
             double entrainment;             // the rate of entrainment at the site
             
             // calculate entrainment as a function of basal pres
-            if (contact.ras[y][x] == 0.0) {
+            if (contact.ras[y][x] == 0) {
                 // cavity entrainment rate is a predefined constant
                 entrainment = sim.entrainment_cavity;
             } else {
@@ -627,20 +1803,9 @@ class stab {
             return (entrainment);
         }    
         
-        void apply_dsurf () {
-            /* method to apply dsurf and modify the surface and iceload rasters
-            */
-            
-            for (int y = 0; y < sim.ydim; y++) {
-                for (int x = 0; x < sim.xdim; x++) {
-                    surf.ras[y][x] = surf.ras[y][x] + dsurf.ras[y][x];
-                    iceload.ras[y][x] = iceload.ras[y][x] + diceload.ras[y][x];
-                }
-            }
-        }    
-            
-        void iceload_bleed () {
-            /* method to add or remove a given amount of sediment from the iceload. In cases
+        template <bool diffusive>
+        void iceload_bleed_cell (int y, int x, stab_flux_log & fl) {
+            /* method to add or remove a given amount of sediment from the iceload of a cell. In cases
             the specified amount of iceload bleed will not be possible because the local iceload
             will be 0.0. Thus there is a global iceload_bleed log variable to keep track of things.
             
@@ -649,77 +1814,75 @@ class stab {
             
             Updated for 1.0, the iceload bleed can either be diffusive (e.g., a property of the
             local iceload), or not diffusive, in which the straight amount of specified bleed is
-            subtracted from the cell.
+            subtracted from the cell. This is set with the diffusive template argument (see
+            iceload_bleed_diffusive).
+            
+            This is only called if the iceload bleed is nonzero (see select_step).
+            y = the target y coordinate
+            x = the target x coordinate
+            fl = the log sums
             */
             
-            bool diffusive = false;                             // set whether to bleed diffusively
             double cell_bleed;                                  // the amount to modify each cell
             
-            // check to make sure we have a bleed assigned, note there is no fudge as this is straight param read
-            if (sim.iceload_bleed != 0.0) {
+            // calculate cell bleed
+            if (diffusive) {
+                cell_bleed = sim.iceload_bleed * sim.len_timestep * iceload.ras[y][x];
+            } else {
+                cell_bleed = sim.iceload_bleed * sim.len_timestep;
+            }
             
-                for (int y = 0; y < sim.ydim; y++) {
-                    for (int x = 0; x < sim.xdim; x++) {
-                        
-                        // calculate cell bleed
-                        if (diffusive) {
-                            cell_bleed = sim.iceload_bleed * sim.len_timestep * iceload.ras[y][x];
-                        } else {
-                            cell_bleed = sim.iceload_bleed * sim.len_timestep;
-                        }
-                        
-                        // try to change the iceload at the cell
-                        if (iceload.ras[y][x] - cell_bleed < 0.0) {
-                            cell_bleed = iceload.ras[y][x];
-                            iceload.ras[y][x] = 0.0;
-                        } else {
-                            iceload.ras[y][x] = iceload.ras[y][x] - cell_bleed;
-                        }
-                        
-                        // log the bleed to the iceload_bleed logger
-                        sl.iceload_bleed = sl.iceload_bleed + cell_bleed;
-                    }
-                }
+            // try to change the iceload at the cell
+            if (iceload.ras[y][x] - cell_bleed < 0.0) {
+                cell_bleed = iceload.ras[y][x];
+                iceload.ras[y][x] = 0.0;
+            } else {
+                iceload.ras[y][x] = iceload.ras[y][x] - cell_bleed;
             }
+            
+            // log the bleed to the iceload_bleed logger
+            fl.iceload_bleed = fl.iceload_bleed + cell_bleed;
         }
         
-        void surf_bleed () {
-            /* method to add or remove a given amount of sediment to the surface of the model
-            space, and log the bleed. Note that this algorithm only removes sediment that is
-            on the surface, if there is no sediment there, it is not removed.
+        void surf_bleed_cell (int y, int x, stab_flux_log & fl) {
+            /* method to add or remove a given amount of sediment to the surface of a cell, and log
+            the bleed. Note that this algorithm only removes sediment that is on the surface, if there
+            is no sediment there, it is not removed. This is only called if the surface bleed is
+            nonzero (see select_step).
+            y = the target y coordinate
+            x = the target x coordinate
+            fl = the log sums
             */
             
             double cell_bleed;                                  // the amount to modify each cell
             
-            // check to make sure we have a bleed assigned, note there is no fudge as this is straight param read
-            if (sim.surf_bleed != 0.0) {
+            // calculate cell bleed
+            cell_bleed = sim.surf_bleed * sim.len_timestep;
             
-                for (int y = 0; y < sim.ydim; y++) {
-                    for (int x = 0; x < sim.xdim; x++) {
-                
-                        // calculate cell bleed
-                        cell_bleed = sim.surf_bleed * sim.len_timestep;
-                        
-                        // try to remove the sediment from each cell
-                        if (surf.ras[y][x] - cell_bleed < bsmt.ras[y][x]) {
-                            cell_bleed = surf.ras[y][x] - bsmt.ras[y][x];
-                            surf.ras[y][x] = bsmt.ras[y][x];
-                        } else {
-                            surf.ras[y][x] = surf.ras[y][x] - cell_bleed;
-                        }
-                        
-                        // log the bleed to the surf bleed logger
-                        sl.surf_bleed = sl.surf_bleed + cell_bleed;
-                    }
-                }
+            // try to remove the sediment from each cell
+            if (surf.ras[y][x] - cell_bleed < bsmt.ras[y][x]) {
+                cell_bleed = surf.ras[y][x] - bsmt.ras[y][x];
+                surf.ras[y][x] = bsmt.ras[y][x];
+            } else {
+                surf.ras[y][x] = surf.ras[y][x] - cell_bleed;
             }
+            
+            // log the bleed to the surf bleed logger
+            fl.surf_bleed = fl.surf_bleed + cell_bleed;
         }
         
-        void erode_basement () {
-            /* method to erode the basement in exposed regions. Updated for 1.0 with many changes (see changelog).
+        template <bool erosion>
+        void erode_basement_cell (int y, int x, stab_flux_log & fl) {
+            /* method to erode the basement of a cell if exposed. Updated for 1.0 with many changes (see changelog).
             Also note that this doesn't re-calculate the basal pressure or deformation or anything, it is just
             straight modification. This will be re-calculated at the beginning of next timestep to be current for
             the next set of squish, advection, and entrainment calculations.
+            
+            erosion = true if any abrasion parameter is nonzero. If false, the abrasion is zero everywhere
+            and all that remains is resetting the surf raster onto the exposed basement.
+            y = the target y coordinate
+            x = the target x coordinate
+            fl = the log sums
             */
             
             double av_sed;                  // available sediment at a site
@@ -728,38 +1891,35 @@ class stab {
             double N_abrasion;              // abrasion from N
             double iceload_abrasion;        // abrasion from iceload
             
-            for (int y = 0; y < sim.ydim; y++) {
-                for (int x = 0; x < sim.xdim; x++) {
+            // check to see if the basement is exposed and we have contact
+            if (contact.ras[y][x] == 1) {
+                av_sed = surf.ras[y][x] - bsmt.ras[y][x];
+                if (av_sed < 0.0000000001 && av_sed > -0.0000000001 && !erosion) {
+                    surf.ras[y][x] = bsmt.ras[y][x];                        // reset surf raster
+                } else if (av_sed < 0.0000000001 && av_sed > -0.0000000001) {
+                    // here ice is in direct contact with the basement and we need to evaluate the amount of basement
+                    // to erode. This is evaluated as an addition of erosion from both N, and from the iceload (eg,
+                    // the Eyles, Krabbendam et al erodent layer theory). The eroded sediment is delivered to both
+                    // the iceload and the surface sediment as defined in the parameter file.
                     
-                    // check to see if the basement is exposed and we have contact
-                    if (contact.ras[y][x] == 1.0) {
-                        av_sed = surf.ras[y][x] - bsmt.ras[y][x];
-                        if (av_sed < 0.0000000001 && av_sed > -0.0000000001) {
-                            // here ice is in direct contact with the basement and we need to evaluate the amount of basement
-                            // to erode. This is evaluated as an addition of erosion from both N, and from the iceload (eg,
-                            // the Eyles, Krabbendam et al erodent layer theory). The eroded sediment is delivered to both
-                            // the iceload and the surface sediment as defined in the parameter file.
-                            
-                            // calculate the pressure abrasion, and the iceload abrasion, to sum with total requested abrasion
-                            N_abrasion = sim.len_timestep * (sim.abrasion_from_N_zero + (basal_pres.ras[y][x] * sim.abrasion_from_N_slope));
-                            iceload_abrasion = sim.len_timestep * iceload.ras[y][x] * sim.abrasion_from_iceload;
-                            req_abrasion = N_abrasion + iceload_abrasion;
-                            
-                            // multiply the requested abrasion by the local erodibilty to determine the volume of sediment eroded
-                            abrasion = req_abrasion * (sim.global_bsmt_erodibility + erodibility.ras[y][x]);
-                            
-                            // erode the basement
-                            bsmt.ras[y][x] = bsmt.ras[y][x] - abrasion;             // erode basement
-                            surf.ras[y][x] = bsmt.ras[y][x];                        // reset surf raster (drops with bsmt)
-                            
-                            // add sediment to the iceload or surface, and log the abrasion
-                            iceload.ras[y][x] = iceload.ras[y][x] + (sim.iceload_surf_return_fraction * abrasion);
-                            surf.ras[y][x] = surf.ras[y][x] + ((1.0 - sim.iceload_surf_return_fraction) * abrasion);
-                            sl.abrasion = sl.abrasion + abrasion;                   // log the abrasion
-                        }
-                    }
+                    // calculate the pressure abrasion, and the iceload abrasion, to sum with total requested abrasion
+                    N_abrasion = sim.len_timestep * (sim.abrasion_from_N_zero + (basal_pres.ras[y][x] * sim.abrasion_from_N_slope));
+                    iceload_abrasion = sim.len_timestep * iceload.ras[y][x] * sim.abrasion_from_iceload;
+                    req_abrasion = N_abrasion + iceload_abrasion;
+                    
+                    // multiply the requested abrasion by the local erodibilty to determine the volume of sediment eroded
+                    abrasion = req_abrasion * (sim.global_bsmt_erodibility + erodibility.ras[y][x]);
+                    
+                    // erode the basement
+                    bsmt.ras[y][x] = bsmt.ras[y][x] - abrasion;             // erode basement
+                    surf.ras[y][x] = bsmt.ras[y][x];                        // reset surf raster (drops with bsmt)
+                    
+                    // add sediment to the iceload or surface, and log the abrasion
+                    iceload.ras[y][x] = iceload.ras[y][x] + (sim.iceload_surf_return_fraction * abrasion);
+                    surf.ras[y][x] = surf.ras[y][x] + ((1.0 - sim.iceload_surf_return_fraction) * abrasion);
+                    fl.abrasion = fl.abrasion + abrasion;                   // log the abrasion
                 }
-            }    
+            }
         }    
         
         bool check_state () {
@@ -768,7 +1928,7 @@ class stab {
             */
             
             bool error = false;
-            if (isnan(surf.sum()) || isnan(dsurf.sum()) || isnan(ice.sum()) || isnan(basal_def.sum()) || isnan(basal_pres.sum()) ||
+            if (isnan(surf.sum()) || isnan(ice.sum()) || isnan(basal_def.sum()) || isnan(basal_pres.sum()) ||
                   isnan(iceload.sum())) {
                 cout << "NAN ERROR FOUND!!" << endl;
                 print_raster_summaries();
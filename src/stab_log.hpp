@@ -29,6 +29,40 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+struct stab_flux_log {
+    /* the logging variables summed over the cells in the row sweeps and the squish. Each row (or
+    chunk of squish polls) is summed into its own stab_flux_log, and these are then added to the
+    stab_log in order (see stab_log::add_fluxes), so the totals do not depend on the number of
+    threads.
+    */
+    double Q_ad;                                            // advection flux
+    double Q_sq_n;                                          // squish flux to north
+    double Q_sq_s;                                          // squish flux to south
+    double Q_sq_e;                                          // squish flux to east
+    double Q_sq_w;                                          // squish flux to west
+    double Q_entrain;                                       // entrainment into iceload
+    double Q_distrain;                                      // distrainment from iceload
+    double total_bleed;                                     // sediment advected out of the model space
+    double iceload_bleed;                                   // iceload bleed
+    double surf_bleed;                                      // bleed from the surface
+    double abrasion;                                        // abrasion
+    
+    void reset () {
+        // method to reset the sums
+        Q_ad = 0.0;
+        Q_sq_n = 0.0;
+        Q_sq_s = 0.0;
+        Q_sq_e = 0.0;
+        Q_sq_w = 0.0;
+        Q_entrain = 0.0;
+        Q_distrain = 0.0;
+        total_bleed = 0.0;
+        iceload_bleed = 0.0;
+        surf_bleed = 0.0;
+        abrasion = 0.0;
+    }
+};
+
 class stab_log {
     public:
         /* This class contains the logging variables for the stab model and writing methods.
@@ -114,6 +148,23 @@ class stab_log {
             total_bedsed = 0.0;
         }    
 
+        void add_fluxes (stab_flux_log & f) {
+            /* method to add the sums of a row from a sweep (or a chunk of squish polls)
+            f = the sums for the row
+            */
+            Q_ad = Q_ad + f.Q_ad;
+            Q_sq_n = Q_sq_n + f.Q_sq_n;
+            Q_sq_s = Q_sq_s + f.Q_sq_s;
+            Q_sq_e = Q_sq_e + f.Q_sq_e;
+            Q_sq_w = Q_sq_w + f.Q_sq_w;
+            Q_entrain = Q_entrain + f.Q_entrain;
+            Q_distrain = Q_distrain + f.Q_distrain;
+            total_bleed = total_bleed + f.total_bleed;
+            iceload_bleed = iceload_bleed + f.iceload_bleed;
+            surf_bleed = surf_bleed + f.surf_bleed;
+            abrasion = abrasion + f.abrasion;
+        }
+        
         void create_status_report (string fname) {
             /* method to initialize the status file with the header row
             Argument:
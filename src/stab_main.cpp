@@ -57,6 +57,17 @@ is an if statement on lines 224 in simulation.hpp that is a workaround to deal
 with compiler differences between Linux and Windows for reading text strings.
 This is a likely source of problems if using some other compiler. Let me know
 your experiences and modifications if using some other compiler (tbarchyn@gmail.com).
+
+Compile time options: these are set with -D flags to the compiler (e.g., 'python make.py
+-DSTAB_SQUISH_AOS'), so that the alternatives can be benchmarked on the same simfile.
+STAB_SQUISH_AOS = interleave the squish values into one record per cell (see stab_squish.hpp)
+TB_CELLGRID_TILED = store cell records in 8 x 8 tiles (one page each) rather than row by row, use
+    with STAB_SQUISH_AOS to keep squish neighbours on the same page (see tb_cellgrid.hpp)
+STAB_NO_SIMD = leave out the vector kernels and always run the scalar reference (see stab_simd.hpp)
+STAB_FLOAT = store the model state rasters as float rather than double, which halves the memory
+    and memory traffic of the rasters. The calculations, the logging sums (stab_kinematics.csv)
+    and the raster summaries are still carried out in double. Check the effect of the reduced
+    precision on a simfile with 'python validate.py precision <simfile>'.
 */
 
 
@@ -67,11 +78,15 @@ your experiences and modifications if using some other compiler (tbarchyn@gmail.
 #include <iostream>
 #include <cstdlib>
 #include <cstdio>
+#include <cerrno>
 #include <stdio.h>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <vector>
 #include <math.h>
+#include <limits>
+#include <stdint.h>
 #include <sys/time.h>
 
 using namespace std;
@@ -83,14 +98,31 @@ int t = 0;                      // integer time for discrete time intervals
 const double pi = 3.1415926535897932384626433;
 bool verbose = false;           // toggle verbose outputs for those in need of lots of model feedback
 
+// precision of the model state rasters (see compile time options)
+#ifdef STAB_FLOAT
+typedef float stab_real;
+#else
+typedef double stab_real;
+#endif
+
 // model headers
-#include "mersenne_twister.h"   // random number generator
+#include "tb_philox.hpp"        // counter based random number generator
 #include "timeprinter.hpp"      // time printer accessory function
 #include "plot_progress.hpp"    // wrapper to call R imaging scripts
 #include "tb_raster.hpp"        // model raster and boundaries objects
+#include "tb_threads.hpp"       // row band threading
+#include "tb_tasks.hpp"         // task graph over bands of rows
+#include "tb_numa.hpp"          // memory placement on multi-socket computers
+#include "tb_cellgrid.hpp"      // interleaved cell record grid
 #include "tb_poll.hpp"          // random site poller
 #include "simulation.hpp"       // simulation class which stores local simulation properties
 #include "stab_log.hpp"         // logging engine
+
+typedef tb_raster_t <stab_real> stab_raster;   // model state raster
+typedef tb_raster_t <unsigned char> stab_mask;  // model mask raster (0 or 1 in each cell)
+
+#include "stab_squish.hpp"      // squish state views
+#include "stab_simd.hpp"        // vector kernels
 #include "stab.hpp"             // model engine
 
 // MAIN
@@ -125,22 +157,29 @@ int main(int nArgs, char *pszArgs[]) {
     
     // sort out the arguments
     // Argument 1 = simfilename: this is the name of the simfile which stores simulation properties
-    // Argument 2 (optional) = -v: this sets the verbose flag high and the program outputs additional info
+    // Optional arguments after the simfile, in any order:
+    //     -v: this sets the verbose flag high and the program outputs additional info
+    //     -t N: run with N threads (this overrides the simfile threads key)
     
     if (nArgs == 1) {
         cout << "ERROR: this program requires 1 argument, which is the simfile path" << endl;
-        cout << "There is an optional second argument, which is '-v' to toggle verbose output" << endl;
+        cout << "There are optional arguments after it, '-v' to toggle verbose output and '-t N' to run" << endl;
+        cout << "with N threads" << endl;
         exit(2);
     }
     
     string simfilename = pszArgs[1];            // grab the first argument
+    int threads = 0;                            // number of threads (0 to take the simfile threads key)
     
-    if (nArgs == 3) {
-        string verbose_argument = pszArgs[2];
-        if (verbose_argument == "-v") {
+    for (int i = 2; i < nArgs; i++) {
+        string argument = pszArgs[i];
+        if (argument == "-v") {
             verbose = true;                     // set verbose flag high
+        } else if (argument == "-t" && i + 1 < nArgs && atoi (pszArgs[i + 1]) > 0) {
+            threads = atoi (pszArgs[i + 1]);    // set the number of threads
+            i++;
         } else {
-            cout << "ERROR: cannot parse your second argument: " << verbose_argument << endl;
+            cout << "ERROR: cannot parse your argument: " << argument << endl;
             exit (2);
         }
     }
@@ -155,7 +194,7 @@ int main(int nArgs, char *pszArgs[]) {
     cout << "------------------------------------------------------------------" << endl;
     cout << "INITIALIZING" << endl;
     stab stab;                                  // create the model engine
-    stab.init (simfilename);                    // initialize model engine
+    stab.init (simfilename, threads);           // initialize model engine
     time_printer tp;                            // create the time printer
     tp.init (stab.sim.max_iterations);          // initialize the time printer
     
@@ -0,0 +1,633 @@
+/*
+STAB: subglacial till advection and bedforms
+Thomas E. Barchyn - University of Calgary, Calgary, AB, Canada
+
+Copyright 2014-2016 Thomas E. Barchyn
+Contact: Thomas E. Barchyn [tbarchyn@gmail.com]
+
+This project was developed with input from Thomas P.F. Dowling,
+Chris R. Stokes, and Chris H. Hugenholtz. We would appreciate
+citation of the relavent publications.
+
+Barchyn, T. E., T. P. F. Dowling, C. R. Stokes, and C. H. Hugenholtz (2016),
+Subglacial bed form morphology controlled by ice speed and sediment thickness,
+Geophys. Res. Lett., 43, doi:10.1002/2016GL069558
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+Please familiarize yourself with the license of this tool, available
+in the distribution with the filename: /docs/license.txt
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Vector kernels: these are branchless versions of the row sweeps in the stab class (move_ice and
+the post squish row: advection, entrainment, basement erosion and the bleeds). Each kernel works
+on a vector of cells at a time with the g++ vector extensions, with the if statements in the
+scalar code replaced by masks and blends. The scalar methods in stab.hpp remain the reference.
+
+The kernels are written once (as templates on the vector type) and compiled three times, for
+SSE2 (2 cells per vector), AVX2 (4 cells) and AVX-512 (8 cells). The best set for the cpu is
+picked when the engine starts up (see simd_select). The simfile 'simd' key can cap the
+instruction set, or turn the kernels 'off' to run the scalar reference.
+
+Notes:
+1. Every cell value is calculated with the same operations in the same order as the scalar
+code, so the rasters are identical to the scalar reference. The log sums of a row
+(stab_kinematics.csv) are added a lane at a time in the order of the cells (see simd_add_lanes),
+the same order as the scalar code, so the sums are identical too.
+2. The kernels read and write whole vectors, relying on tb_raster rows starting on a cache
+line and carrying slack past xdim. The cells past xdim are masked out of writes and sums.
+3. With float state rasters (-DSTAB_FLOAT) the kernels still calculate in double between the
+loads and stores. The scalar code does some of its arithmetic in float (e.g., surf - bsmt), so
+the two can differ in the last bit of a float cell.
+4. The random draws for the advection stochasticity are filled into rand_row by a vector
+Philox generator (simd_random_row) before the advection pass, from the same counter based
+stream as the scalar code (see tb_philox.hpp), so the draw of each cell is the same.
+5. The kernels are only compiled with g++ (or compatible) on x86. Elsewhere, or when compiled
+with -DSTAB_NO_SIMD, the engine runs the scalar reference.
+6. The kernels work on a band of rows (or one row) so each thread can run them on its own band,
+with its own simd_grid: the row buffers are separate for each thread.
+*/
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(STAB_NO_SIMD)
+#define STAB_SIMD
+#endif
+
+#ifdef STAB_SIMD
+
+#include <immintrin.h>
+
+#define SIMD_INLINE inline __attribute__ ((always_inline))
+
+// keep g++ from fusing multiplies and adds in the kernels (AVX-512 has fused multiply add), these
+// round differently to the scalar code
+#pragma GCC push_options
+#pragma GCC optimize ("fp-contract=off")
+
+struct simd_grid {
+    // row pointers to the engine rasters, the row buffers of a thread, and the parameters the kernels
+    // need (see stab::select_simd)
+    stab_real ** surf;
+    stab_real ** bsmt;
+    stab_real ** ice;
+    stab_real ** basal_def;
+    stab_real ** basal_pres;
+    stab_real ** zero_elev;
+    unsigned char ** contact;
+    stab_real ** iceload;
+    stab_real ** erodibility;
+    double * rand_row;                      // random draws for the row (advection stochasticity)
+    double * Q_ad_row;                      // advection flux for the row (Q_ad_row[-1] is 0.0)
+    double * Q_en_row;                      // entrainment flux for the row
+    stab_real * ice_row;                    // ice of the row before the move (from ice_row[-1])
+    stab_real * iceload_row;                // iceload of the row before the move (from iceload_row[-1])
+    int ydim;
+    int xdim;
+
+    double t_wgt;                           // ice advection target cell weight
+    double w_wgt;                           // ice advection west cell weight
+    double zero_elev_shift;                 // drop from the ice to the elevation of zero basal pres
+    double basal_force;                     // global basal pres for the iteration
+    double basal_pres_fudge;                // fudge in the basal pres equality test
+    double len_timestep;
+    double viscosity;
+    double cellsize;
+    double Q_advection_global;
+    double Q_advection_stochasticity;
+    double entrainment_cavity;
+    double entrainment_zero;
+    double entrainment_slp_1;
+    double entrainment_vtx_2;
+    double entrainment_slp_2;
+    double abrasion_from_N_zero;
+    double abrasion_from_N_slope;
+    double abrasion_from_iceload;
+    double global_bsmt_erodibility;
+    double iceload_surf_return_fraction;
+    double surf_bleed;
+    double iceload_bleed;
+};
+
+const int simd_max_width = 8;               // most cells in a vector (AVX-512), used to pad row buffers
+
+// vector types for each instruction set, vd holds doubles, vl holds lane masks (or indices), vu
+// holds unsigned words (for the random numbers), and vf and vb hold the same number of floats
+// (for float state rasters) and bytes (for masks)
+struct simd_sse2 {
+    typedef double vd __attribute__ ((vector_size (16)));
+    typedef long long vl __attribute__ ((vector_size (16)));
+    typedef unsigned long long vu __attribute__ ((vector_size (16)));
+    typedef float vf __attribute__ ((vector_size (8)));
+    typedef unsigned char vb __attribute__ ((vector_size (2)));
+    static const int width = 2;
+
+    static __attribute__ ((target ("sse2"))) inline void mul32 (vu & p, const vu & a, const vu & b) {
+        // multiply the low 32 bits of each lane of a and b into the 64 bit lanes of p
+        p = (vu)_mm_mul_epu32 ((__m128i)a, (__m128i)b);
+    }
+};
+
+struct simd_avx2 {
+    typedef double vd __attribute__ ((vector_size (32)));
+    typedef long long vl __attribute__ ((vector_size (32)));
+    typedef unsigned long long vu __attribute__ ((vector_size (32)));
+    typedef float vf __attribute__ ((vector_size (16)));
+    typedef unsigned char vb __attribute__ ((vector_size (4)));
+    static const int width = 4;
+
+    static __attribute__ ((target ("avx2"))) inline void mul32 (vu & p, const vu & a, const vu & b) {
+        // multiply the low 32 bits of each lane of a and b into the 64 bit lanes of p
+        p = (vu)_mm256_mul_epu32 ((__m256i)a, (__m256i)b);
+    }
+};
+
+struct simd_avx512 {
+    typedef double vd __attribute__ ((vector_size (64)));
+    typedef long long vl __attribute__ ((vector_size (64)));
+    typedef unsigned long long vu __attribute__ ((vector_size (64)));
+    typedef float vf __attribute__ ((vector_size (32)));
+    typedef unsigned char vb __attribute__ ((vector_size (8)));
+    static const int width = 8;
+
+    static __attribute__ ((target ("avx512f"))) inline void mul32 (vu & p, const vu & a, const vu & b) {
+        // multiply the low 32 bits of each lane of a and b into the 64 bit lanes of p
+        // (the masked form with all lanes set, the plain form trips a g++ uninitialized warning)
+        p = (vu)_mm512_mask_mul_epu32 ((__m512i)p, (__mmask8)0xff, (__m512i)a, (__m512i)b);
+    }
+};
+
+// vector helpers, vectors are passed by reference to keep the calling convention out of it. The
+// kernels always calculate in double: float cells are widened on load and rounded on store.
+template <class isa>
+SIMD_INLINE void simd_load (typename isa::vd & v, const double * p) {
+    memcpy (&v, p, sizeof (v));
+}
+
+template <class isa>
+SIMD_INLINE void simd_load (typename isa::vd & v, const float * p) {
+    typename isa::vf f;
+    memcpy (&f, p, sizeof (f));
+    v = __builtin_convertvector (f, typename isa::vd);
+}
+
+template <class isa>
+SIMD_INLINE void simd_load (typename isa::vd & v, const unsigned char * p) {
+    typename isa::vb b;
+    memcpy (&b, p, sizeof (b));
+    v = __builtin_convertvector (b, typename isa::vd);
+}
+
+template <class isa>
+SIMD_INLINE void simd_store (double * p, const typename isa::vd & v, const typename isa::vl & m, bool full) {
+    // store the lanes set in m, or all the lanes if full
+    if (full) {
+        memcpy (p, &v, sizeof (v));
+    } else {
+        typename isa::vd old;
+        simd_load <isa> (old, p);
+        typename isa::vd out = m ? v : old;
+        memcpy (p, &out, sizeof (out));
+    }
+}
+
+template <class isa>
+SIMD_INLINE void simd_store (float * p, const typename isa::vd & v, const typename isa::vl & m, bool full) {
+    // store the lanes set in m, or all the lanes if full (rounded to float)
+    typename isa::vd out = v;
+    if (!full) {
+        typename isa::vd old;
+        simd_load <isa> (old, p);
+        out = m ? v : old;
+    }
+    typename isa::vf f = __builtin_convertvector (out, typename isa::vf);
+    memcpy (p, &f, sizeof (f));
+}
+
+template <class isa>
+SIMD_INLINE void simd_store (unsigned char * p, const typename isa::vd & v, const typename isa::vl & m, bool full) {
+    // store the lanes set in m, or all the lanes if full (the values must be whole numbers 0 to 255)
+    typename isa::vd out = v;
+    if (!full) {
+        typename isa::vd old;
+        simd_load <isa> (old, p);
+        out = m ? v : old;
+    }
+    typename isa::vb b = __builtin_convertvector (out, typename isa::vb);
+    memcpy (p, &b, sizeof (b));
+}
+
+template <class vl>
+SIMD_INLINE void simd_lanes (vl & m, int n) {
+    // mask of the first n lanes (all lanes if n >= width)
+    for (int i = 0; i < (int)(sizeof (vl) / sizeof (long long)); i++) {
+        m[i] = (i < n) ? -1 : 0;
+    }
+}
+
+template <class vd>
+SIMD_INLINE void simd_add_lanes (double & sum, const vd & v, int n) {
+    // add the first n lanes to a sum one at a time, in the order of the cells (all lanes if n >= width)
+    for (int i = 0; i < (int)(sizeof (vd) / sizeof (double)) && i < n; i++) {
+        sum = sum + v[i];
+    }
+}
+
+template <class isa>
+SIMD_INLINE void simd_move_ice (simd_grid & g, int y0, int y1) {
+    /* vector version of stab::move_ice_rows (for rows y0 to y1 - 1), including calc_basal_pres. The
+    ice and iceload halos must be current. The old ice and iceload of each row are copied into the
+    row buffers first, so the rasters can be updated in place.
+    */
+    typedef typename isa::vd vd;
+    typedef typename isa::vl vl;
+    const int w = isa::width;
+    const vd zero = vd ();
+    const vd one = zero + 1.0;
+    vd ice_w, ice_t, load_w, load_t, surf, temploc, zero_elev, basal_def, basal_pres, contact;
+    vd n_ice, n_iceload;
+    vl m = vl (), cavity;
+    bool full;
+
+    for (int y = y0; y < y1; y++) {
+        memcpy (g.ice_row - 1, &g.ice[y][-1], (g.xdim + 1) * sizeof (stab_real));
+        memcpy (g.iceload_row - 1, &g.iceload[y][-1], (g.xdim + 1) * sizeof (stab_real));
+
+        for (int x = 0; x < g.xdim; x = x + w) {
+            full = (x + w <= g.xdim);
+            simd_lanes (m, g.xdim - x);
+            simd_load <isa> (ice_w, &g.ice_row[x - 1]);
+            simd_load <isa> (ice_t, &g.ice_row[x]);
+            simd_load <isa> (load_w, &g.iceload_row[x - 1]);
+            simd_load <isa> (load_t, &g.iceload_row[x]);
+            simd_load <isa> (surf, &g.surf[y][x]);
+
+            temploc = (g.w_wgt * ice_w) + (g.t_wgt * ice_t);
+            zero_elev = temploc - g.zero_elev_shift;
+            basal_def = surf - temploc;
+            basal_pres = g.basal_force + ((basal_def / g.len_timestep) * g.viscosity);
+
+            // cavities have no basal pres and the ice sags to the elevation of zero basal pres
+            cavity = (basal_pres - g.basal_pres_fudge) < 0.0;
+            basal_pres = cavity ? zero : basal_pres;
+            contact = cavity ? zero : one;
+            basal_def = cavity ? (zero_elev - temploc) : basal_def;
+            n_ice = cavity ? zero_elev : surf;
+            n_iceload = (g.w_wgt * load_w) + (g.t_wgt * load_t);
+
+            simd_store <isa> (&g.zero_elev[y][x], zero_elev, m, full);
+            simd_store <isa> (&g.basal_def[y][x], basal_def, m, full);
+            simd_store <isa> (&g.basal_pres[y][x], basal_pres, m, full);
+            simd_store <isa> (&g.contact[y][x], contact, m, full);
+            simd_store <isa> (&g.ice[y][x], n_ice, m, full);
+            simd_store <isa> (&g.iceload[y][x], n_iceload, m, full);
+        }
+    }
+}
+
+template <class isa>
+SIMD_INLINE void simd_random_row (simd_grid & g, const tb_philox & rng, uint32_t s0, uint32_t s1, uint64_t n0) {
+    /* vector version of tb_philox::fill for a row of draws turned into [0, 1] (as tb_philox::real1):
+    rand_row[x] is word n0 + x of the stream (s0, s1). Each lane hashes its own block, so a vector
+    makes 4 * width draws. The 32 bit words are carried in 64 bit lanes, and turned into doubles
+    exactly by setting them as the low bits of 2^52 and taking 2^52 off.
+    rng = the generator
+    s0, s1 = the stream
+    n0 = the first word of the row
+    */
+    typedef typename isa::vd vd;
+    typedef typename isa::vu vu;
+    const int w = isa::width;
+    const vu lo = (vu () + 0xffffffffULL);
+    const vu exp52 = (vu () + 0x4330000000000000ULL);
+    const vu m0 = (vu () + 0xD2511F53ULL);
+    const vu m1 = (vu () + 0xCD9E8D57ULL);
+    const double two52 = 4503599627370496.0;
+    const vu stream0 = (vu () + (unsigned long long)s0);
+    const vu stream1 = (vu () + (unsigned long long)s1);
+    vu key0[10];                                    // the key of each round
+    vu key1[10];
+    vu lane = vu ();                                // block offset of each lane
+    vu c0, c1, blocks;
+    vu c2 = vu ();
+    vu c3 = vu ();
+    vu p0 = vu ();                                  // products of the rounds
+    vu p1 = vu ();
+    vu words[4];
+    vd d[4];
+    uint64_t first = n0 >> 2;                       // first block of the row
+    uint64_t last = (n0 + g.xdim + 3) >> 2;         // block past the row
+    long long x0, x;                                // the first cell of the blocks, and a cell
+
+    for (int l = 0; l < w; l++) {
+        lane[l] = l;
+    }
+    for (int r = 0; r < 10; r++) {
+        key0[r] = vu () + (unsigned long long)(uint32_t)(rng.k0 + (r * 0x9E3779B9U));
+        key1[r] = vu () + (unsigned long long)(uint32_t)(rng.k1 + (r * 0xBB67AE85U));
+    }
+
+    for (uint64_t b = first; b < last; b = b + w) {
+        blocks = (vu () + (unsigned long long)b) + lane;
+        c0 = blocks & lo;
+        c1 = blocks >> 32;
+        c2 = stream0;
+        c3 = stream1;
+
+        for (int r = 0; r < 10; r++) {
+            isa::mul32 (p0, c0, m0);
+            isa::mul32 (p1, c2, m1);
+            c0 = (p1 >> 32) ^ c1 ^ key0[r];
+            c1 = p1 & lo;
+            c2 = (p0 >> 32) ^ c3 ^ key1[r];
+            c3 = p0 & lo;
+        }
+
+        words[0] = c0;
+        words[1] = c1;
+        words[2] = c2;
+        words[3] = c3;
+        for (int j = 0; j < 4; j++) {
+            words[j] = words[j] | exp52;
+            memcpy (&d[j], &words[j], sizeof (vd));
+            d[j] = (d[j] - two52) * (1.0 / 4294967295.0);
+        }
+
+        // put the words in order, block by block, straight into the row if the blocks are all in it
+        x0 = (long long)((b << 2) - n0);
+        if (x0 >= 0 && x0 + (4 * w) <= g.xdim) {
+            for (int l = 0; l < w; l++) {
+                for (int j = 0; j < 4; j++) {
+                    g.rand_row[x0 + (4 * l) + j] = d[j][l];
+                }
+            }
+        } else {
+            for (int l = 0; l < w; l++) {
+                for (int j = 0; j < 4; j++) {
+                    x = x0 + (4 * l) + j;
+                    if (x >= 0 && x < g.xdim) {
+                        g.rand_row[x] = d[j][l];
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <class isa>
+SIMD_INLINE void simd_round (typename isa::vd & v) {
+    // round the lanes to stab_real, as a store to the state rasters and a load back would
+    typedef typename isa::vl vl;
+    stab_real r[simd_max_width];
+    vl all = vl ();
+    simd_store <isa> (r, v, all, true);
+    simd_load <isa> (v, r);
+}
+
+template <class isa>
+SIMD_INLINE void simd_post_squish_row (simd_grid & g, int y, bool stochastic, bool periodic_ew, bool erosion,
+                                       bool bleed_surf, bool bleed_iceload, bool diffusive, stab_flux_log & fl) {
+    /* vector version of stab::post_squish_row_cells, including calc_advection_entrainment,
+    erode_basement_cell and the bleeds. The basal_pres halo must be current.
+
+    The fluxes for the row are worked out first (into Q_ad_row and Q_en_row), then a second pass
+    sets the changes from the fluxes and the advection from the west cell (Q_ad_row[x - 1]),
+    erodes the basement, applies the changes and bleeds the surface and iceload, all on the same
+    vectors. Each step is rounded to stab_real where the state rasters would be stored, so the
+    cells are the same as running the steps one after another.
+
+    stochastic = true if the advection is stochastic, with the draws for the row in rand_row
+    periodic_ew = true if the advection off the east edge lands on the west edge, else it bleeds
+    erosion = true if basement abrasion is active
+    bleed_surf, bleed_iceload = true if the bleeds are active
+    diffusive = true to bleed the iceload diffusively
+    fl = the log sums of the row
+    */
+    typedef typename isa::vd vd;
+    typedef typename isa::vl vl;
+    const int w = isa::width;
+    const vd zero = vd ();
+    vd bp, bp_e, rep_bp, r, Q_ad, Q_en, Q_ad_w, entrainment, surf, bsmt, iceload, contact, erodibility;
+    vd req_ero, av_sed, reduce_frac, Q_ad_in;
+    vd dsurf, diceload, abrasion, cell_bleed, left;
+    vl m = vl (), cavity, incursion, entraining, exposed, limited;
+    bool full;
+    stab_real Q_ad_off;                     // advection off the east edge
+    stab_real dsurf_0;                      // surface change of the west edge cell
+    double surf_bleed = g.surf_bleed * g.len_timestep;
+    double iceload_bleed = g.iceload_bleed * g.len_timestep;
+
+    // first, the fluxes
+    for (int x = 0; x < g.xdim; x = x + w) {
+        simd_lanes (m, g.xdim - x);
+        simd_load <isa> (bp, &g.basal_pres[y][x]);
+        simd_load <isa> (bp_e, &g.basal_pres[y][x + 1]);
+        simd_load <isa> (surf, &g.surf[y][x]);
+        simd_load <isa> (bsmt, &g.bsmt[y][x]);
+        simd_load <isa> (iceload, &g.iceload[y][x]);
+        simd_load <isa> (contact, &g.contact[y][x]);
+
+        // advection
+        rep_bp = (bp + bp_e) / 2.0;
+        Q_ad = (rep_bp * g.Q_advection_global * g.len_timestep) / g.cellsize;
+        if (stochastic) {
+            simd_load <isa> (r, &g.rand_row[x]);
+            Q_ad = Q_ad + ((r - 0.5) * Q_ad * g.Q_advection_stochasticity);
+            Q_ad = (Q_ad < 0.0) ? zero : Q_ad;
+        }
+        Q_ad = (rep_bp > 0.0) ? Q_ad : zero;
+
+        // entrainment
+        entrainment = (bp < g.entrainment_vtx_2) ? ((bp * g.entrainment_slp_1) + g.entrainment_zero) :
+                      (((bp - g.entrainment_vtx_2) * g.entrainment_slp_2) +
+                       (g.entrainment_vtx_2 * g.entrainment_slp_1) + g.entrainment_zero);
+        cavity = (contact == 0.0);
+        entrainment = cavity ? (zero + g.entrainment_cavity) : entrainment;
+        entrainment = entrainment * g.len_timestep;
+        Q_en = ((iceload + entrainment) < 0.0) ? (-1.0 * iceload) : entrainment;
+
+        // basement incursion
+        req_ero = Q_ad + Q_en;
+        incursion = ((surf - req_ero) < bsmt) & (req_ero != 0.0);
+        entraining = (Q_en > 0.0);
+        av_sed = surf - bsmt;
+        reduce_frac = av_sed / req_ero;
+        Q_ad_in = entraining ? (reduce_frac * Q_ad) : (Q_ad - (req_ero - av_sed));
+        Q_ad = incursion ? Q_ad_in : Q_ad;
+        Q_en = (incursion & entraining) ? (reduce_frac * Q_en) : Q_en;
+
+        // keep the cells past xdim out of the sums
+        Q_ad = m ? Q_ad : zero;
+        Q_en = m ? Q_en : zero;
+        simd_store <isa> (&g.Q_ad_row[x], Q_ad, m, true);
+        simd_store <isa> (&g.Q_en_row[x], Q_en, m, true);
+
+        // log fluxes
+        entraining = (Q_en > 0.0);
+        simd_add_lanes (fl.Q_ad, Q_ad, g.xdim - x);
+        simd_add_lanes (fl.Q_entrain, entraining ? Q_en : zero, g.xdim - x);
+        simd_add_lanes (fl.Q_distrain, entraining ? zero : (-1.0 * Q_en), g.xdim - x);
+    }
+
+    // the advection off the east edge lands on the west edge, or bleeds
+    Q_ad_off = g.Q_ad_row[g.xdim - 1];
+    if (!periodic_ew) {
+        fl.total_bleed = fl.total_bleed + Q_ad_off;
+    }
+
+    // then the changes, the erosion and the bleeds, a vector of cells at a time
+    for (int x = 0; x < g.xdim; x = x + w) {
+        full = (x + w <= g.xdim);
+        simd_lanes (m, g.xdim - x);
+
+        // the cell gets the advection from the west cell, less the advection and entrainment here
+        simd_load <isa> (Q_ad_w, &g.Q_ad_row[x - 1]);
+        simd_load <isa> (Q_ad, &g.Q_ad_row[x]);
+        simd_load <isa> (Q_en, &g.Q_en_row[x]);
+        dsurf = Q_ad_w - Q_ad - Q_en;
+        diceload = Q_en;
+        simd_round <isa> (dsurf);
+        simd_round <isa> (diceload);
+        if (periodic_ew && x == 0) {
+            dsurf_0 = dsurf[0];
+            dsurf_0 = dsurf_0 + Q_ad_off;
+            dsurf[0] = dsurf_0;
+        }
+
+        // basement erosion
+        simd_load <isa> (surf, &g.surf[y][x]);
+        simd_load <isa> (bsmt, &g.bsmt[y][x]);
+        simd_load <isa> (iceload, &g.iceload[y][x]);
+        simd_load <isa> (contact, &g.contact[y][x]);
+
+        av_sed = surf - bsmt;
+        exposed = (contact == 1.0) & (av_sed < 0.0000000001) & (av_sed > -0.0000000001) & m;
+
+        if (!erosion) {
+            surf = exposed ? bsmt : surf;
+        } else {
+            simd_load <isa> (bp, &g.basal_pres[y][x]);
+            simd_load <isa> (erodibility, &g.erodibility[y][x]);
+
+            abrasion = (g.len_timestep * (g.abrasion_from_N_zero + (bp * g.abrasion_from_N_slope))) +
+                       (g.len_timestep * iceload * g.abrasion_from_iceload);
+            abrasion = abrasion * (g.global_bsmt_erodibility + erodibility);
+            abrasion = exposed ? abrasion : zero;
+
+            r = bsmt - abrasion;
+            surf = exposed ? (r + ((1.0 - g.iceload_surf_return_fraction) * abrasion)) : surf;
+            iceload = exposed ? (iceload + (g.iceload_surf_return_fraction * abrasion)) : iceload;
+            bsmt = exposed ? r : bsmt;
+            simd_round <isa> (surf);
+            simd_round <isa> (iceload);
+            simd_round <isa> (bsmt);
+            simd_store <isa> (&g.bsmt[y][x], bsmt, m, full);
+            simd_add_lanes (fl.abrasion, abrasion, g.xdim - x);
+        }
+
+        // apply the changes
+        surf = surf + dsurf;
+        iceload = iceload + diceload;
+
+        // surface bleed, only remove the sediment that is there
+        if (bleed_surf) {
+            simd_round <isa> (surf);
+            limited = (surf - surf_bleed) < bsmt;
+            cell_bleed = limited ? (surf - bsmt) : (zero + surf_bleed);
+            surf = limited ? bsmt : (surf - surf_bleed);
+            simd_add_lanes (fl.surf_bleed, cell_bleed, g.xdim - x);
+        }
+
+        // iceload bleed, only remove the iceload that is there
+        if (bleed_iceload) {
+            simd_round <isa> (iceload);
+            if (diffusive) {
+                cell_bleed = iceload_bleed * iceload;
+            } else {
+                cell_bleed = zero + iceload_bleed;
+            }
+            left = iceload - cell_bleed;
+            limited = left < 0.0;
+            cell_bleed = limited ? iceload : cell_bleed;
+            iceload = limited ? zero : left;
+            simd_add_lanes (fl.iceload_bleed, cell_bleed, g.xdim - x);
+        }
+
+        simd_store <isa> (&g.surf[y][x], surf, m, full);
+        simd_store <isa> (&g.iceload[y][x], iceload, m, full);
+    }
+}
+
+struct simd_kernels {
+    // kernels compiled for one instruction set (see STAB_SIMD_ISA)
+    const char * name;
+    void (*move_ice) (simd_grid &, int, int);
+    void (*random_row) (simd_grid &, const tb_philox &, uint32_t, uint32_t, uint64_t);
+    void (*post_squish_row) (simd_grid &, int, bool, bool, bool, bool, bool, bool, stab_flux_log &);
+};
+
+// compile the kernels for an instruction set, and a function to fill in the kernel table
+#define STAB_SIMD_ISA(isa, target_isa)                                                                          \
+    __attribute__ ((target (target_isa))) void simd_move_ice_##isa (simd_grid & g, int y0, int y1) {           \
+        simd_move_ice <simd_##isa> (g, y0, y1);                                                                 \
+    }                                                                                                           \
+    __attribute__ ((target (target_isa))) void simd_random_row_##isa (simd_grid & g, const tb_philox & rng,     \
+                                                                     uint32_t s0, uint32_t s1, uint64_t n0) {   \
+        simd_random_row <simd_##isa> (g, rng, s0, s1, n0);                                                      \
+    }                                                                                                           \
+    __attribute__ ((target (target_isa))) void simd_post_squish_row_##isa (simd_grid & g, int y, bool stochastic,  \
+                             bool periodic_ew, bool erosion, bool bleed_surf, bool bleed_iceload, bool diffusive,  \
+                             stab_flux_log & fl) {                                                              \
+        simd_post_squish_row <simd_##isa> (g, y, stochastic, periodic_ew, erosion, bleed_surf, bleed_iceload,   \
+                                            diffusive, fl);                                                     \
+    }                                                                                                           \
+    void simd_kernels_##isa (simd_kernels & k) {                                                                \
+        k.name = #isa;                                                                                          \
+        k.move_ice = &simd_move_ice_##isa;                                                                      \
+        k.random_row = &simd_random_row_##isa;                                                                  \
+        k.post_squish_row = &simd_post_squish_row_##isa;                                                        \
+    }
+
+STAB_SIMD_ISA (sse2, "sse2")
+STAB_SIMD_ISA (avx2, "avx2")
+STAB_SIMD_ISA (avx512, "avx512f")
+
+#pragma GCC pop_options
+
+bool simd_select (simd_kernels & k, string cap) {
+    /* function to pick the best kernels the cpu supports, up to the instruction set cap. Returns
+    false (the scalar reference) if the cap is 'off'.
+
+    cap = the simfile simd key: 'auto', 'avx512', 'avx2', 'sse2' or 'off'
+    */
+    if (cap != "auto" && cap != "avx512" && cap != "avx2" && cap != "sse2" && cap != "off") {
+        cout << "ERROR: cannot parse the simd option: " << cap << endl;
+        exit (10);
+    }
+
+    __builtin_cpu_init ();
+
+    if (cap == "off") {
+        return (false);
+    } else if ((cap == "auto" || cap == "avx512") && __builtin_cpu_supports ("avx512f")) {
+        simd_kernels_avx512 (k);
+    } else if ((cap == "auto" || cap == "avx512" || cap == "avx2") && __builtin_cpu_supports ("avx2")) {
+        simd_kernels_avx2 (k);
+    } else if (__builtin_cpu_supports ("sse2")) {
+        simd_kernels_sse2 (k);
+    } else {
+        return (false);
+    }
+    return (true);
+}
+
+#endif
@@ -0,0 +1,122 @@
+/*
+STAB: subglacial till advection and bedforms
+Thomas E. Barchyn - University of Calgary, Calgary, AB, Canada
+
+Copyright 2014-2016 Thomas E. Barchyn
+Contact: Thomas E. Barchyn [tbarchyn@gmail.com]
+
+This project was developed with input from Thomas P.F. Dowling,
+Chris R. Stokes, and Chris H. Hugenholtz. We would appreciate
+citation of the relavent publications.
+
+Barchyn, T. E., T. P. F. Dowling, C. R. Stokes, and C. H. Hugenholtz (2016),
+Subglacial bed form morphology controlled by ice speed and sediment thickness,
+Geophys. Res. Lett., 43, doi:10.1002/2016GL069558
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+Please familiarize yourself with the license of this tool, available
+in the distribution with the filename: /docs/license.txt
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Squish state views: the squish visits cells in random order and needs seven values at the
+target and each of its four neighbours. The squish methods in the stab class are written
+against a 'view' which hands back references to these values, so the same code runs
+against either layout:
+
+squish_soa_view: the values are read straight from the engine rasters (one raster per
+    value, or 'structure of arrays'). This is the default.
+squish_aos_view: the values are interleaved into one 64 byte squish_cell record per cell
+    (or 'array of structures'), so a random visit pulls a single cache line. The engine
+    packs the records from the rasters before the squish and unpacks them afterwards.
+    Compile with -DSTAB_SQUISH_AOS to use this layout, and add -DTB_CELLGRID_TILED to store
+    the records in page sized tiles (see tb_cellgrid.hpp).
+*/
+
+struct squish_cell {
+    // interleaved record of the values the squish needs at a cell (the compiler pads the record
+    // out to 64 bytes, or 32 with float state)
+    stab_real surf;                         // surface elevation
+    stab_real bsmt;                         // basement elevation
+    stab_real ice;                          // ice elevation
+    stab_real basal_def;                    // ice base deformation
+    stab_real basal_pres;                   // basal pres
+    stab_real zero_elev;                    // elevation of zero basal pres
+    stab_real pad;                          // padding
+    unsigned char contact;                  // contact (0 = cavity, 1 = contact)
+};
+
+class squish_soa_view {
+    // view of the squish values held in separate engine rasters (holds the raster row pointers)
+    public:
+        stab_real ** surf_ras;
+        stab_real ** bsmt_ras;
+        stab_real ** ice_ras;
+        stab_real ** basal_def_ras;
+        stab_real ** basal_pres_ras;
+        unsigned char ** contact_ras;
+        stab_real ** zero_elev_ras;
+
+        squish_soa_view (stab_raster & surf_in, stab_raster & bsmt_in, stab_raster & ice_in, stab_raster & basal_def_in,
+                         stab_raster & basal_pres_in, stab_mask & contact_in, stab_raster & zero_elev_in) {
+            surf_ras = surf_in.ras;
+            bsmt_ras = bsmt_in.ras;
+            ice_ras = ice_in.ras;
+            basal_def_ras = basal_def_in.ras;
+            basal_pres_ras = basal_pres_in.ras;
+            contact_ras = contact_in.ras;
+            zero_elev_ras = zero_elev_in.ras;
+        }
+
+        inline stab_real & surf (int y, int x) { return (surf_ras[y][x]); }
+        inline stab_real & bsmt (int y, int x) { return (bsmt_ras[y][x]); }
+        inline stab_real & ice (int y, int x) { return (ice_ras[y][x]); }
+        inline stab_real & basal_def (int y, int x) { return (basal_def_ras[y][x]); }
+        inline stab_real & basal_pres (int y, int x) { return (basal_pres_ras[y][x]); }
+        inline unsigned char & contact (int y, int x) { return (contact_ras[y][x]); }
+        inline stab_real & zero_elev (int y, int x) { return (zero_elev_ras[y][x]); }
+};
+
+class squish_aos_view {
+    // view of the squish values held in interleaved squish_cell records
+    public:
+        tb_cellgrid <squish_cell> * g;
+
+        squish_aos_view (tb_cellgrid <squish_cell> & g_in) {
+            g = &g_in;
+        }
+
+        inline stab_real & surf (int y, int x) { return ((*g)(y, x).surf); }
+        inline stab_real & bsmt (int y, int x) { return ((*g)(y, x).bsmt); }
+        inline stab_real & ice (int y, int x) { return ((*g)(y, x).ice); }
+        inline stab_real & basal_def (int y, int x) { return ((*g)(y, x).basal_def); }
+        inline stab_real & basal_pres (int y, int x) { return ((*g)(y, x).basal_pres); }
+        inline unsigned char & contact (int y, int x) { return ((*g)(y, x).contact); }
+        inline stab_real & zero_elev (int y, int x) { return ((*g)(y, x).zero_elev); }
+};
+
+struct stab_sq_flux {
+    // squish from a cell to each of its neighbours, kept between the passes of the two pass squish
+    double n;                               // squish to the north
+    double s;                               // squish to the south
+    double e;                               // squish to the east
+    double w;                               // squish to the west
+};
+
+// the view used by the engine squish, selected at compile time
+#ifdef STAB_SQUISH_AOS
+typedef squish_aos_view squish_view;
+#else
+typedef squish_soa_view squish_view;
+#endif
@@ -0,0 +1,212 @@
+// tb_arena - aligned memory arena for model simulations
+// Thomas E. Barchyn - University of Calgary, Calgary, AB, Canada
+
+/*
+Copyright 2015-2016 Thomas E. Barchyn
+Contact: Thomas E. Barchyn [tbarchyn@gmail.com]
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+Please familiarize yourself with the license of this tool, available
+in the distribution with the filename: license.txt
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef __linux__
+#include <sys/mman.h>                   // madvise for transparent huge pages, mmap for file backed blocks
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+class tb_arena {
+    /* This class holds one block of memory that is handed out in pieces (e.g., to all the
+    rasters of a model), so a model makes one allocation rather than one per array, and frees
+    it all when the arena goes out of scope. Each piece starts on a cache line (64 bytes).
+
+    The arena is sized up front: add up the mem_size of each piece (rounded with tb_arena::round)
+    and pass the total to init, then take the pieces. Taking more than was sized is an error.
+
+    The block can also be backed by a scratch file rather than memory (out-of-core runs): the
+    file is mapped into memory, so the pieces are used the same way, but the operating system
+    pages them in and out of the file as they are used. This lets a model exceed the memory of
+    the computer, at the cost of speed if it does not work through the memory in order.
+
+    The arena owns its block, so it can be moved but not copied.
+    */
+
+    public:
+        char * mem;                         // raw allocation backing the block
+        char * block;                       // aligned start of the block
+        size_t len;                         // usable length of the block in bytes
+        size_t used;                        // bytes handed out so far
+        bool huge_pages;                    // true if transparent huge pages were requested for the block
+        bool mapped;                        // true if the block is mapped from a scratch file
+
+        static const size_t align = 64;                     // alignment of each piece in bytes
+        static const size_t huge_align = 2 * 1024 * 1024;   // alignment of the block for huge pages
+
+        tb_arena () {
+            // constructor is just a placeholder, must call init
+            mem = NULL;
+            block = NULL;
+            len = 0;
+            used = 0;
+            huge_pages = false;
+            mapped = false;
+        }
+
+        ~tb_arena () {
+            release ();
+        }
+
+        tb_arena (const tb_arena &) = delete;
+        tb_arena & operator= (const tb_arena &) = delete;
+
+        tb_arena (tb_arena && other) {
+            // take over the block of another arena
+            mem = NULL;
+            take_over (other);
+        }
+
+        tb_arena & operator= (tb_arena && other) {
+            if (this != &other) {
+                release ();
+                take_over (other);
+            }
+            return (*this);
+        }
+
+        static size_t round (size_t bytes) {
+            // round a piece up to whole cache lines
+            return (((bytes + align - 1) / align) * align);
+        }
+
+        void init (size_t len_in, bool huge_pages_in, string file = "") {
+            /* method to allocate the block
+            len_in = the length of the block in bytes (the sum of the rounded pieces)
+            huge_pages_in = true to ask the kernel to back the block with transparent huge pages
+                (linux only, the block is aligned to a 2 MB boundary and the request is advisory)
+            file = a scratch file to back the block (see map_file), or empty to use memory
+            */
+            release ();
+            len = round (len_in);
+            used = 0;
+            huge_pages = huge_pages_in;
+            
+            if (!file.empty ()) {
+                map_file (file);
+                return;
+            }
+
+            size_t block_align = huge_pages ? huge_align : align;
+
+            try {
+                mem = new char [len + block_align];
+            } catch(...) {
+                cout << "ERROR: cannot allocate sufficient memory!" << endl;
+                exit (10);
+            }
+
+            size_t offset = (block_align - ((size_t)mem % block_align)) % block_align;
+            block = mem + offset;
+
+            #if defined(__linux__) && defined(MADV_HUGEPAGE)
+            if (huge_pages && len < huge_align) {
+                huge_pages = false;                 // too small to fill a huge page
+            } else if (huge_pages && madvise (block, (len / huge_align) * huge_align, MADV_HUGEPAGE) != 0) {
+                cout << "WARNING: transparent huge pages are not available . . ";
+                huge_pages = false;
+            }
+            #else
+            huge_pages = false;
+            #endif
+        }
+
+        template <class T>
+        T * take (size_t n) {
+            /* method to hand out the next piece of the block, starting on a cache line
+            n = the number of T in the piece
+            */
+            size_t bytes = round (n * sizeof (T));
+            if (used + bytes > len) {
+                cout << "ERROR: memory arena is too small, the pieces do not match the size!" << endl;
+                exit (10);
+            }
+            T * piece = (T *)(block + used);
+            used = used + bytes;
+            return (piece);
+        }
+
+        void map_file (string file) {
+            /* method to back the block with a scratch file (linux only). The file is created (or
+            truncated), sized, mapped, and then removed from the directory straight away, so the
+            space is returned when the arena is released or the program ends. The file should be
+            on a local disk with room for the whole block. Huge pages are not used.
+            file = the path of the scratch file
+            */
+            huge_pages = false;
+            #if defined(__linux__)
+            int fd = open (file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+            if (fd < 0) {
+                cout << "ERROR: cannot create the scratch file: " << file << endl;
+                exit (10);
+            }
+            unlink (file.c_str());
+            if (ftruncate (fd, (off_t)len) != 0) {
+                cout << "ERROR: cannot size the scratch file: " << file << endl;
+                exit (10);
+            }
+            void * p = mmap (NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close (fd);                                 // the mapping holds the file open
+            if (p == MAP_FAILED) {
+                cout << "ERROR: cannot map the scratch file: " << file << endl;
+                exit (10);
+            }
+            block = (char *)p;                          // page aligned
+            mapped = true;
+            #else
+            cout << "ERROR: file backed memory is only supported on linux" << endl;
+            exit (10);
+            #endif
+        }
+
+        void release () {
+            // method to free the block (everything taken from the arena is gone)
+            #if defined(__linux__)
+            if (mapped) {
+                munmap (block, len);
+            }
+            #endif
+            mapped = false;
+            delete [] mem;
+            mem = NULL;
+            block = NULL;
+            len = 0;
+            used = 0;
+        }
+
+    private:
+        void take_over (tb_arena & other) {
+            // method to take the block from another arena, leaving it empty
+            mem = other.mem;
+            block = other.block;
+            len = other.len;
+            used = other.used;
+            huge_pages = other.huge_pages;
+            mapped = other.mapped;
+            other.mem = NULL;
+            other.mapped = false;
+            other.block = NULL;
+            other.len = 0;
+            other.used = 0;
+        }
+};
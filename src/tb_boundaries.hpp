@@ -21,6 +21,8 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "tb_arena.hpp"                 // aligned memory arena
+
 class tb_boundaries {
     public:
         /* This class contains lookup arrays for boundaries. This is more or less an
@@ -57,12 +59,20 @@ class tb_boundaries {
         int xdim;               // x dimensions
         string boundaries_ns;   // boundaries north-south
         string boundaries_ew;   // boundaries east-west
+        bool periodic_ns;       // true if the north-south boundaries are periodic
+        bool periodic_ew;       // true if the east-west boundaries are periodic
+        tb_arena own;           // memory for the lookups if they are not in a shared arena
         
         tb_boundaries () {
             // constructor is just a placeholder
         }
         
-        void init (int ydim_in, int xdim_in, string boundaries_ns_in, string boundaries_ew_in) {
+        static size_t mem_size (int ydim_in, int xdim_in) {
+            // bytes of arena needed for the lookups (see init)
+            return ((8 * tb_arena::round (ydim_in * sizeof (int))) + (8 * tb_arena::round (xdim_in * sizeof (int))));
+        }
+        
+        void init (int ydim_in, int xdim_in, string boundaries_ns_in, string boundaries_ew_in, tb_arena * arena = NULL) {
             /* initialize the boundary lookups
             
             Arguments:
@@ -70,6 +80,8 @@ class tb_boundaries {
             xdim_in = x dimensions (number of cols)
             boundaries_ns_in = input boundaries north-south
             boundaries_ew_in = input boundaries east-west
+            arena = a shared arena (sized with mem_size) to take the lookups from, or NULL to
+                allocate them in this object
             */
             
             if (verbose) {
@@ -80,29 +92,30 @@ class tb_boundaries {
             xdim = xdim_in;
             boundaries_ns = boundaries_ns_in;           
             boundaries_ew = boundaries_ew_in;
+            periodic_ns = (boundaries_ns == "periodic");
+            periodic_ew = (boundaries_ew == "periodic");
             
             // allocate some memory first
-            try {
-                n1 = new int [ydim];
-                s1 = new int [ydim];
-                e1 = new int [xdim];
-                w1 = new int [xdim];
-                n1m = new int [ydim];
-                s1m = new int [ydim];
-                e1m = new int [xdim];
-                w1m = new int [xdim];
-                y_1cdw_n = new int [ydim];
-                x_1cdw_n = new int [xdim];
-                y_1cdw_s = new int [ydim];
-                x_1cdw_s = new int [xdim];
-                y_1cdw_e = new int [ydim];
-                x_1cdw_e = new int [xdim];
-                y_1cdw_w = new int [ydim];
-                x_1cdw_w = new int [xdim];
-			} catch(...) {
-				cout << "BOUNDARIES ERROR: cannot allocate sufficient memory!" << endl;
-				exit (10);
-			}
+            if (arena == NULL) {
+                own.init (mem_size (ydim, xdim), false);
+                arena = &own;
+            }
+            n1 = arena->take <int> (ydim);
+            s1 = arena->take <int> (ydim);
+            e1 = arena->take <int> (xdim);
+            w1 = arena->take <int> (xdim);
+            n1m = arena->take <int> (ydim);
+            s1m = arena->take <int> (ydim);
+            e1m = arena->take <int> (xdim);
+            w1m = arena->take <int> (xdim);
+            y_1cdw_n = arena->take <int> (ydim);
+            x_1cdw_n = arena->take <int> (xdim);
+            y_1cdw_s = arena->take <int> (ydim);
+            x_1cdw_s = arena->take <int> (xdim);
+            y_1cdw_e = arena->take <int> (ydim);
+            x_1cdw_e = arena->take <int> (xdim);
+            y_1cdw_w = arena->take <int> (ydim);
+            x_1cdw_w = arena->take <int> (xdim);
 
             toxic_coord = -1;          // set the toxic coordinate
             
@@ -257,5 +270,62 @@ class tb_boundaries {
         }
 };
 
-
-
+template <bool periodic>
+class tb_edge {
+    /* Compile time version of the boundary lookups along one axis. Kernels that are
+    templated on the boundary type use these in place of the lookup arrays, so that
+    periodic boundaries compile down to wrap around arithmetic, and the toxic_coord
+    tests compile away entirely. The results are identical to the lookup arrays above.
+    */
+    public:
+        static const int toxic_coord = -1;      // matches tb_boundaries::toxic_coord
+        
+        static inline int fwd (int i, int dim) {
+            // looking: 1 cell forward (north or east)
+            if (i + 1 == dim) {
+                return (periodic ? 0 : i);
+            }
+            return (i + 1);
+        }
+        
+        static inline int back (int i, int dim) {
+            // looking: 1 cell back (south or west)
+            if (i == 0) {
+                return (periodic ? dim - 1 : 0);
+            }
+            return (i - 1);
+        }
+        
+        static inline int fwd_move (int i, int dim) {
+            // movement: 1 cell forward, toxic off a nonperiodic edge
+            if (i + 1 == dim) {
+                return (periodic ? 0 : toxic_coord);
+            }
+            return (i + 1);
+        }
+        
+        static inline int back_move (int i, int dim) {
+            // movement: 1 cell back, toxic off a nonperiodic edge
+            if (i == 0) {
+                return (periodic ? dim - 1 : toxic_coord);
+            }
+            return (i - 1);
+        }
+        
+        static inline int shift (int i, int d, int dim) {
+            // movement: d cells forward (or back if negative, up to dim cells), toxic off a nonperiodic edge
+            int j = i + d;
+            if (j < 0) {
+                return (periodic ? j + dim : toxic_coord);
+            }
+            if (j >= dim) {
+                return (periodic ? j - dim : toxic_coord);
+            }
+            return (j);
+        }
+        
+        static inline bool is_toxic (int i) {
+            // test for the toxic coordinate, never true for periodic boundaries
+            return (!periodic && i == toxic_coord);
+        }
+};
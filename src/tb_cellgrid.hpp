@@ -0,0 +1,109 @@
+// tb_cellgrid - generic grid of interleaved cell records for model simulations
+// Thomas E. Barchyn - University of Calgary, Calgary, AB, Canada
+
+/*
+Copyright 2015-2016 Thomas E. Barchyn
+Contact: Thomas E. Barchyn [tbarchyn@gmail.com]
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+Please familiarize yourself with the license of this tool, available
+in the distribution with the filename: license.txt
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+template <class cell_t>
+class tb_cellgrid {
+    /* This class stores a grid of cell records (an 'array of structures'), as opposed to
+    tb_raster which stores one value per cell. This is useful where a random visit to a
+    cell needs several values at once: all the values sit together in memory and a visit
+    pulls one record rather than one cache line from each of a number of rasters.
+    
+    As with tb_raster, the records are taken from a shared arena or held by the grid itself.
+    */
+
+    public:
+        cell_t * cells;                     // cell records
+        int ydim;                           // nrows
+        int xdim;                           // ncols
+        int tiles_x;                        // number of tiles along x (tiled layout)
+        size_t len;                         // number of records allocated (including tile padding)
+        tb_arena own;                       // memory for the records if they are not in a shared arena
+
+        tb_cellgrid () {
+            // constructor is just a placeholder, must call init
+        }
+
+        static size_t calc_len (int ydim_in, int xdim_in) {
+            // number of records to allocate for a grid of these dimensions
+            #ifdef TB_CELLGRID_TILED
+            // pad the grid out to whole tiles
+            return ((size_t)((ydim_in + 7) / 8) * ((xdim_in + 7) / 8) * 64);
+            #else
+            return ((size_t)ydim_in * xdim_in);
+            #endif
+        }
+
+        static size_t mem_size (int ydim_in, int xdim_in) {
+            // bytes of arena needed for a grid of these dimensions (see init)
+            return (tb_arena::round (calc_len (ydim_in, xdim_in) * sizeof (cell_t)));
+        }
+
+        void init (int ydim_in, int xdim_in, tb_arena * arena = NULL) {
+            /* method to initialize the grid
+
+            ydim_in = the y dimensions of the grid
+            xdim_in = the x dimensions of the grid
+            arena = a shared arena (sized with mem_size) to take the records from, or NULL to
+                allocate them in this grid
+            */
+            ydim = ydim_in;
+            xdim = xdim_in;
+            if (arena == NULL) {
+                own.init (mem_size (ydim, xdim), false);
+                arena = &own;
+            }
+            allocate_mem (arena);
+        }
+
+        void allocate_mem (tb_arena * arena) {
+            /* method to take the cell records from the arena as one block aligned to a cache line (64 bytes)
+            */
+            #ifdef TB_CELLGRID_TILED
+            tiles_x = (xdim + 7) / 8;
+            #else
+            tiles_x = 0;
+            #endif
+            len = calc_len (ydim, xdim);
+            cells = arena->take <cell_t> (len);
+        }
+
+        inline cell_t & operator() (int y, int x) {
+            // access the cell record at y, x
+            return (cells[index (y, x)]);
+        }
+        
+        inline size_t index (int y, int x) {
+            /* method to return the storage index of the record at y, x
+            */
+            #ifdef TB_CELLGRID_TILED
+            // tile index, then the row and column within the tile
+            size_t tile = ((size_t)(y >> 3) * tiles_x) + (x >> 3);
+            return ((tile << 6) + ((y & 7) << 3) + (x & 7));
+            #else
+            return (((size_t)y * xdim) + x);
+            #endif
+        }
+};
+
+
+
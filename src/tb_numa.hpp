@@ -0,0 +1,152 @@
+// tb_numa - memory placement on multi-socket (NUMA) computers
+// Thomas E. Barchyn - University of Calgary, Calgary, AB, Canada
+
+/*
+Copyright 2015-2016 Thomas E. Barchyn
+Contact: Thomas E. Barchyn [tbarchyn@gmail.com]
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+Please familiarize yourself with the license of this tool, available
+in the distribution with the filename: license.txt
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+NUMA functions: on a multi-socket computer each socket has its own memory, and reaching the
+memory of another socket is slower. By default a page goes to the memory of the socket whose
+thread first writes it ('first touch'). These functions set other policies for a range of
+memory and report where the pages of a range ended up. They call the linux system calls
+directly (no libnuma needed), and do nothing elsewhere. Up to 64 nodes are handled.
+*/
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+const int tb_numa_max_nodes = 64;           // nodes that fit in the node mask
+const int tb_mpol_bind = 2;                 // MPOL_BIND in linux/mempolicy.h
+const int tb_mpol_interleave = 3;           // MPOL_INTERLEAVE in linux/mempolicy.h
+
+int tb_numa_nodes () {
+    /* function to return the number of memory nodes (1 if not known)
+    */
+    int nodes = 0;
+    #ifdef __linux__
+    for (int i = 0; i < tb_numa_max_nodes; i++) {
+        ostringstream path;
+        path << "/sys/devices/system/node/node" << i;
+        if (access (path.str().c_str(), F_OK) == 0) {
+            nodes = i + 1;
+        }
+    }
+    #endif
+    if (nodes == 0) {
+        nodes = 1;
+    }
+    return (nodes);
+}
+
+size_t tb_page_size () {
+    // function to return the page size in bytes
+    #ifdef __linux__
+    return ((size_t)sysconf (_SC_PAGESIZE));
+    #else
+    return (4096);
+    #endif
+}
+
+bool tb_numa_policy (void * p, size_t len, int mode, unsigned long mask) {
+    /* function to set the memory policy of the whole pages in a range, returns false if this
+    failed (or is not supported). The pages must not be written yet to follow the policy.
+    p = start of the range
+    len = length of the range in bytes
+    mode = tb_mpol_bind or tb_mpol_interleave
+    mask = bit mask of the nodes to use
+    */
+    #if defined(__linux__) && defined(SYS_mbind)
+    size_t page = tb_page_size ();
+    size_t start = (((size_t)p + page - 1) / page) * page;         // whole pages only
+    size_t end = (((size_t)p + len) / page) * page;
+    if (end <= start) {
+        return (true);
+    }
+    return (syscall (SYS_mbind, start, end - start, mode, &mask, (unsigned long)tb_numa_max_nodes, 0) == 0);
+    #else
+    return (false);
+    #endif
+}
+
+bool tb_numa_interleave (void * p, size_t len, int nodes) {
+    // function to spread the pages of a range across the first nodes in turn (see tb_numa_policy)
+    unsigned long mask = (nodes >= tb_numa_max_nodes) ? ~0UL : ((1UL << nodes) - 1);
+    return (tb_numa_policy (p, len, tb_mpol_interleave, mask));
+}
+
+bool tb_numa_bind (void * p, size_t len, int node) {
+    // function to put the pages of a range on one node (see tb_numa_policy)
+    return (tb_numa_policy (p, len, tb_mpol_bind, 1UL << node));
+}
+
+string tb_numa_report (void * p, size_t len) {
+    /* function to return a summary of where the pages of a range are, as the percent of the
+    pages on each node (sampled, up to 4096 pages) and the percent not yet written, or 'not
+    available'.
+    p = start of the range
+    len = length of the range in bytes
+    */
+    ostringstream report;
+    #if defined(__linux__) && defined(SYS_move_pages)
+    size_t page = tb_page_size ();
+    size_t start = ((size_t)p / page) * page;
+    size_t pages = (((size_t)p + len + page - 1) / page) - (start / page);
+    size_t samples = (pages < 4096) ? pages : 4096;
+    if (samples == 0) {
+        return ("not available");
+    }
+
+    vector <void *> addrs (samples);
+    vector <int> status (samples);
+    for (size_t i = 0; i < samples; i++) {
+        addrs[i] = (void *)(start + (((i * pages) / samples) * page));
+    }
+
+    // with no target nodes, move_pages just reports the node of each page
+    if (syscall (SYS_move_pages, 0, (unsigned long)samples, &addrs[0], NULL, &status[0], 0) != 0) {
+        return ("not available");
+    }
+
+    vector <size_t> counts (tb_numa_max_nodes, 0);
+    size_t placed = 0;
+    for (size_t i = 0; i < samples; i++) {
+        if (status[i] >= 0 && status[i] < tb_numa_max_nodes) {
+            counts[status[i]]++;
+            placed++;
+        }
+    }
+    if (placed == 0) {
+        return ("not available");
+    }
+    for (int i = 0; i < tb_numa_max_nodes; i++) {
+        if (counts[i] > 0) {
+            report << (report.str().empty () ? "" : ", ") << "node " << i << " " << (100 * counts[i]) / samples << "%";
+        }
+    }
+    if (placed < samples) {
+        report << ", not written " << (100 * (samples - placed)) / samples << "%";
+    }
+    #else
+    report << "not available";
+    #endif
+    return (report.str());
+}
@@ -0,0 +1,157 @@
+// tb_philox - counter based random numbers for model simulations
+// Thomas E. Barchyn - University of Calgary, Calgary, AB, Canada
+
+/*
+Copyright 2015-2016 Thomas E. Barchyn
+Contact: Thomas E. Barchyn [tbarchyn@gmail.com]
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+Please familiarize yourself with the license of this tool, available
+in the distribution with the filename: license.txt
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Counter based random numbers: rather than stepping one generator state along (e.g., the
+Mersenne twister), each block of random bits is a hash of a key (the seed) and a counter. Any
+draw can be worked out on its own from its counter, so threads need no shared state and the
+draws do not depend on which thread takes them or in what order. The hash is Philox4x32-10
+(Salmon et al. 2011, Parallel random numbers: as easy as 1, 2, 3, SC11), which turns a 128 bit
+counter into 128 random bits (4 words).
+
+The counter is laid out as (n, stream), where n is a 64 bit position within the stream and the
+stream is two 32 bit words (e.g., the timestep and what the draws are for). The words of a
+stream are read one at a time with tb_philox_stream, or in bulk with tb_philox::fill (and the
+vector version in stab_simd.hpp).
+*/
+
+class tb_philox {
+    public:
+        uint32_t k0;                        // key, low word of the seed
+        uint32_t k1;                        // key, high word of the seed
+
+        tb_philox () {
+            // constructor sets a zero seed, call init to change
+            k0 = 0;
+            k1 = 0;
+        }
+
+        void init (uint64_t seed) {
+            /* method to set the seed
+            seed = the seed (64 bits)
+            */
+            k0 = (uint32_t)seed;
+            k1 = (uint32_t)(seed >> 32);
+        }
+
+        inline void block (uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t * out) const {
+            /* method to hash a counter into 4 random words, with 10 rounds of Philox
+            c0, c1, c2, c3 = the counter
+            out = the 4 random words
+            */
+            uint32_t key0 = k0;
+            uint32_t key1 = k1;
+            uint64_t p0, p1;
+
+            for (int r = 0; r < 10; r++) {
+                p0 = (uint64_t)0xD2511F53 * c0;
+                p1 = (uint64_t)0xCD9E8D57 * c2;
+                c0 = (uint32_t)(p1 >> 32) ^ c1 ^ key0;
+                c1 = (uint32_t)p1;
+                c2 = (uint32_t)(p0 >> 32) ^ c3 ^ key1;
+                c3 = (uint32_t)p0;
+                key0 = key0 + 0x9E3779B9;           // bump the key (Weyl sequence)
+                key1 = key1 + 0xBB67AE85;
+            }
+            out[0] = c0;
+            out[1] = c1;
+            out[2] = c2;
+            out[3] = c3;
+        }
+
+        void fill (uint32_t s0, uint32_t s1, uint64_t n0, size_t count, uint32_t * out) const {
+            /* method to fill a buffer with words n0 up to n0 + count of the stream (s0, s1), the
+            same words as tb_philox_stream. The whole blocks are hashed straight into the buffer,
+            with no check of a kept block for each word, so this is the way to take draws in bulk.
+            s0, s1 = the stream
+            n0 = the first word
+            count = the number of words
+            out = the buffer (count words)
+            */
+            uint32_t words[4];
+            uint64_t n = n0;
+            uint64_t end = n0 + count;
+            
+            // words up to the first whole block
+            if ((n & 3) != 0) {
+                block ((uint32_t)(n >> 2), (uint32_t)(n >> 34), s0, s1, words);
+                for (; (n & 3) != 0 && n < end; n++) {
+                    *out++ = words[n & 3];
+                }
+            }
+            
+            // whole blocks
+            for (; n + 4 <= end; n = n + 4) {
+                block ((uint32_t)(n >> 2), (uint32_t)(n >> 34), s0, s1, out);
+                out = out + 4;
+            }
+            
+            // words past the last whole block
+            if (n < end) {
+                block ((uint32_t)(n >> 2), (uint32_t)(n >> 34), s0, s1, words);
+                for (; n < end; n++) {
+                    *out++ = words[n & 3];
+                }
+            }
+        }
+        
+        static inline double real1 (uint32_t r) {
+            // turn a random word into a number on [0, 1], as genrand_real1 of the Mersenne twister
+            return (r * (1.0 / 4294967295.0));
+        }
+};
+
+class tb_philox_stream {
+    /* This class reads the 32 bit words of one stream of a tb_philox in order (or any order, but
+    in order is fastest), word n being word n % 4 of the block at counter (n / 4, stream). The
+    last block is kept, so reading in order hashes one block per 4 words.
+    */
+
+    public:
+        const tb_philox * rng;              // generator (seed)
+        uint32_t s0;                        // stream, counter word 2
+        uint32_t s1;                        // stream, counter word 3
+        uint64_t cached;                    // block number of the kept block
+        uint32_t words[4];                  // the kept block
+
+        tb_philox_stream (const tb_philox & rng_in, uint32_t s0_in, uint32_t s1_in) {
+            /* constructor to set up the stream
+            rng_in = the generator
+            s0_in, s1_in = the stream
+            */
+            rng = &rng_in;
+            s0 = s0_in;
+            s1 = s1_in;
+            cached = ~(uint64_t)0;
+        }
+
+        inline uint32_t operator() (uint64_t n) {
+            // method to return word n of the stream
+            uint64_t b = n >> 2;
+            if (b != cached) {
+                rng->block ((uint32_t)b, (uint32_t)(b >> 32), s0, s1, words);
+                cached = b;
+            }
+            return (words[n & 3]);
+        }
+};
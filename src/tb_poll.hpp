@@ -22,66 +22,394 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 class tb_poll {
-    /* This class creates poll sequences for sampling without replacement in iterations
+    /* This class creates poll sequences for sampling without replacement in iterations. The
+    sequence is held as lists of ys and xs, indexed by a 64 bit count (so a grid can have more
+    than 2^31 cells), and each new sequence is a shuffle of the last. The shuffle draws from a
+    counter based generator (see tb_philox.hpp), so a sequence only depends on the seed, the
+    step, and the sequence before it.
+    
+    With a tile size set, the sequence is instead built tile by tile (see calc_tiled_sequence):
+    the grid is cut into square tiles, the tiles are visited in a random order, and the cells of
+    each tile in a random order. Every cell is still visited once in a sequence, but the visits
+    stay within a tile for a while, so the cells being worked on can stay in cache.
+    
+    With the hashed order, the sequence is instead a keyed bijective hash (a Feistel network) of
+    the cell coordinates (see calc_hashed_sequence). Each position is worked out on its own, so
+    the rows are filled in parallel, and the sequence for the next step is filled on a
+    background thread while the caller works through the present one. The background thread is
+    started once (in init) and sleeps between steps, as the small grids run tens of thousands of
+    steps and starting a thread for each would take about as long as the fill.
     */
     
     public:
         int * ys;                       // list of ys
         int * xs;                       // list of xs
-        int * vcoords;                  // vector coordinates
         int ydim;                       // ydim
         int xdim;                       // xdim
-        int len;                        // length of vector coordinates
+        size_t len;                     // length of the lists (ydim * xdim)
+        int tile;                       // side of the tiles in cells, or 0 to shuffle the whole grid
+        vector <size_t> tile_order;     // order of the tiles (see calc_tiled_sequence)
+        
+        bool hashed;                    // true for the hashed order (see calc_hashed_sequence)
+        tb_threads * th;                // threads to fill the hashed sequence
+        int * next_ys;                  // list of ys for the next step (hashed order)
+        int * next_xs;                  // list of xs for the next step (hashed order)
+        int bx;                         // bits of the x coordinate in a hashed cell number
+        int half;                       // bits in each half of the Feistel network
+        uint32_t half_mask;             // mask of the bits of a half
+        
+        bool pending;                   // true if the background thread has been asked for the next lists
+        bool started;                   // true if the background thread is running
+        bool busy;                      // true until the background thread has filled the next lists (under lock)
+        bool quit;                      // true to stop the background thread (under lock)
+        pthread_t worker;               // the background thread
+        pthread_mutex_t lock;           // lock for the requests to the background thread
+        pthread_cond_t wake;            // signalled when the next lists are asked for (or to quit)
+        pthread_cond_t filled;          // signalled when the next lists are filled
+        tb_philox pending_rng;          // the generator, step and stream of the next lists
+        uint32_t pending_step;
+        uint32_t pending_stream;
+        
+        static const int hash_rounds = 4;   // rounds of the Feistel network
+        tb_arena own;                   // memory for the lists if they are not in a shared arena
+        static const int batch = 1024;  // draws taken at a time in calc_new_sequence
   
         tb_poll () {
             // constructor is just placeholder: must call init
+            hashed = false;
+            pending = false;
+            started = false;
+            busy = false;
+            quit = false;
+            pthread_mutex_init (&lock, NULL);
+            pthread_cond_init (&wake, NULL);
+            pthread_cond_init (&filled, NULL);
+        }
+        
+        ~tb_poll () {
+            // stop the background thread (after any fill in progress)
+            finish ();
+            if (started) {
+                pthread_mutex_lock (&lock);
+                quit = true;
+                pthread_cond_signal (&wake);
+                pthread_mutex_unlock (&lock);
+                pthread_join (worker, NULL);
+                started = false;
+            }
+            pthread_mutex_destroy (&lock);
+            pthread_cond_destroy (&wake);
+            pthread_cond_destroy (&filled);
         }
         
-        void init (int ydim_in, int xdim_in) {
+        static size_t mem_size (int ydim_in, int xdim_in, bool hashed_in = false) {
+            // bytes of arena needed for the lists (see init), the hashed order needs two sets
+            return ((hashed_in ? 4 : 2) * tb_arena::round ((size_t)ydim_in * xdim_in * sizeof (int)));
+        }
+        
+        void init (int ydim_in, int xdim_in, tb_arena * arena = NULL, int tile_in = 0, tb_threads * th_in = NULL) {
             /* initialize the polling object
             ydim_in: the assigned y dimensions
             xdim_in: the assigned x dimensions
+            arena: a shared arena (sized with mem_size) to take the lists from, or NULL to
+                allocate them in this object
+            tile_in: the side of the tiles in cells (up to 65535), or 0 for no tiles
+            th_in: the threads to fill the sequence with for the hashed order, or NULL to shuffle
+                (the hashed order cannot be tiled)
             */
             
             ydim = ydim_in;
             xdim = xdim_in;
-            len = ydim * xdim;
+            len = (size_t)ydim * xdim;
+            tile = tile_in;
+            hashed = (th_in != NULL);
+            th = th_in;
+            pending = false;
+            
+            // a cell is numbered (y << bx) | x, and the Feistel halves cover the cell numbers
+            int by = 0;
+            bx = 0;
+            while ((1LL << by) < ydim) {
+                by++;
+            }
+            while ((1LL << bx) < xdim) {
+                bx++;
+            }
+            half = (by + bx + 1) / 2;
+            half_mask = (half >= 32) ? 0xffffffff : ((1U << half) - 1);
             
             // allocate memory
-            try {
-                ys = new int [len];
-                xs = new int [len];
-                vcoords = new int [len];
-            } catch (...) {
-				cout << "ERROR: cannot allocate sufficient memory!" << endl;
-				exit (10);
-			}
+            if (arena == NULL) {
+                own.init (mem_size (ydim, xdim, hashed), false);
+                arena = &own;
+            }
+            ys = arena->take <int> (len);
+            xs = arena->take <int> (len);
+            if (hashed) {
+                next_ys = arena->take <int> (len);
+                next_xs = arena->take <int> (len);
+            }
             
-            // set up the vcoords vector as an ordered sequence
-            for (int i = 0; i < len; i++) {
-                vcoords[i] = i;
+            // set up the lists as an ordered sequence, running up the columns
+            size_t i = 0;
+            for (int x = 0; x < xdim; x++) {
+                for (int y = 0; y < ydim; y++) {
+                    ys[i] = y;
+                    xs[i] = x;
+                    i++;
+                }
             }
             
-            calc_new_sequence ();
+            // start the background thread for the hashed order
+            if (hashed && !started) {
+                if (pthread_create (&worker, NULL, &prefetch_start, this) != 0) {
+                    cout << "ERROR: cannot start the poll sequence thread" << endl;
+                    exit (10);
+                }
+                started = true;
+            }
         }
         
-        void calc_new_sequence () {
-            /* method to set out a new sequence of random samples, without replacement
+        void calc_new_sequence (const tb_philox & rng, uint32_t step, uint32_t stream) {
+            /* method to set out a new sequence of random samples, without replacement. This is a
+            Fisher-Yates shuffle of the (y, x) pairs. Position i takes word i of the random stream
+            (step, stream), which covers up to 2^32 cells. Beyond that, words 2i and 2i + 1 of the
+            stream (step, stream + 1) are combined. With tiles, the sequence is built by
+            calc_tiled_sequence instead.
+            rng = the generator
+            step = the step (e.g., the timestep), so each sequence has its own draws
+            stream = the stream for the draws (the caller's other draws should use other streams)
             */
-            int r;              // the coordinate to shuffle
-            int rval;           // the value to shuffle
+            size_t i = len;             // the position past the next to shuffle
             
-            for (int i = len - 1; i > -1; i--) {
-                r = genrand_int32() % (i + 1);              // draw a random integer
-                rval = vcoords[r];                          // get the value
-                vcoords[r] = vcoords[i];                    // shuffle  
-                vcoords[i] = rval;                          // shuffle
+            if (hashed) {
+                calc_hashed_sequence (rng, step, stream);
+                return;
             }
-
-            // apply the shuffled vcoords to the lookup arrays
-            for (int i = 0; i < len; i++) {
-                xs[i] = vcoords[i] / ydim;
-                ys[i] = vcoords[i] % ydim;
+            if (tile > 0) {
+                calc_tiled_sequence (rng, step, stream);
+                return;
+            }
+            
+            tb_philox_stream rs_wide (rng, step, stream + 1);
+            for (; i > 0xffffffffUL; i--) {
+                swap (i - 1, ((((uint64_t)rs_wide (2 * (uint64_t)(i - 1))) << 32) | rs_wide ((2 * (uint64_t)(i - 1)) + 1)) % i);
             }
+            shuffle (rng, step, stream, 0, i);
+        }
+        
+        void calc_tiled_sequence (const tb_philox & rng, uint32_t step, uint32_t stream) {
+            /* method to set out a new sequence tile by tile. The tiles are tile x tile cells (cut
+            short at the top and right edges of the grid). The order of the tiles is a Fisher-Yates
+            shuffle, with tile k taking word k of the stream (step, stream + 1). The cells of each
+            tile are then laid out in turn and shuffled in place (see shuffle), so the draws for a
+            cell come from the stream (step, stream) as in calc_new_sequence. The sequence is built
+            fresh each time, rather than as a shuffle of the last.
+            rng = the generator
+            step = the step (e.g., the timestep), so each sequence has its own draws
+            stream = the stream for the draws (this uses stream and stream + 1)
+            */
+            size_t tiles_y = ((size_t)ydim + tile - 1) / tile;
+            size_t tiles_x = ((size_t)xdim + tile - 1) / tile;
+            size_t n_tiles = tiles_y * tiles_x;
+            size_t i = 0;               // the next position in the lists
+            size_t first;               // the first position of the tile
+            size_t r;                   // a random tile position
+            tb_philox_stream rs_tiles (rng, step, stream + 1);
+            
+            // shuffle the order of the tiles
+            tile_order.resize (n_tiles);
+            for (size_t k = 0; k < n_tiles; k++) {
+                tile_order[k] = k;
+            }
+            for (size_t k = n_tiles; k > 1; k--) {
+                r = rs_tiles (k - 1) % k;
+                size_t rval = tile_order[r];
+                tile_order[r] = tile_order[k - 1];
+                tile_order[k - 1] = rval;
+            }
+            
+            // lay out the cells of each tile, and shuffle them
+            for (size_t k = 0; k < n_tiles; k++) {
+                int y0 = (int)((tile_order[k] / tiles_x) * tile);
+                int x0 = (int)((tile_order[k] % tiles_x) * tile);
+                int y1 = min (y0 + tile, ydim);
+                int x1 = min (x0 + tile, xdim);
+                
+                first = i;
+                for (int y = y0; y < y1; y++) {
+                    for (int x = x0; x < x1; x++) {
+                        ys[i] = y;
+                        xs[i] = x;
+                        i++;
+                    }
+                }
+                shuffle (rng, step, stream, first, i);
+            }
+        }
+        
+        void calc_hashed_sequence (const tb_philox & rng, uint32_t step, uint32_t stream) {
+            /* method to set out the hashed sequence for a step (see fill_hashed). If the background
+            thread has filled the next lists for this step these are swapped in, otherwise the
+            lists are filled a band of rows per thread. The background thread is then started on
+            the lists for step + 1. A sequence only depends on the seed, the step and the stream.
+            rng = the generator
+            step = the step (e.g., the timestep), so each sequence has its own keys
+            stream = the stream for the keys
+            */
+            bool done = false;
+            int * rval;
+            
+            if (pending) {
+                finish ();
+                if (pending_step == step && pending_stream == stream && pending_rng.k0 == rng.k0 && pending_rng.k1 == rng.k1) {
+                    rval = ys;
+                    ys = next_ys;
+                    next_ys = rval;
+                    rval = xs;
+                    xs = next_xs;
+                    next_xs = rval;
+                    done = true;
+                }
+            }
+            if (!done) {
+                th->run (ydim, [&] (int y0, int y1, int) {
+                    fill_hashed (rng, step, stream, ys, xs, y0, y1);
+                });
+            }
+            
+            // fill the lists for the next step in the background
+            pending_rng = rng;
+            pending_step = step + 1;
+            pending_stream = stream;
+            pthread_mutex_lock (&lock);
+            busy = true;
+            pthread_cond_signal (&wake);
+            pthread_mutex_unlock (&lock);
+            pending = true;
+        }
+        
+        static void * prefetch_start (void * arg) {
+            // start function of the background thread (see prefetch)
+            ((tb_poll *)arg)->prefetch ();
+            return (NULL);
+        }
+        
+        void prefetch () {
+            // method to fill the next lists each time they are asked for (see calc_hashed_sequence), until quit
+            pthread_mutex_lock (&lock);
+            while (true) {
+                while (!busy && !quit) {
+                    pthread_cond_wait (&wake, &lock);
+                }
+                if (quit) {
+                    break;
+                }
+                pthread_mutex_unlock (&lock);
+                fill_hashed (pending_rng, pending_step, pending_stream, next_ys, next_xs, 0, ydim);
+                pthread_mutex_lock (&lock);
+                busy = false;
+                pthread_cond_signal (&filled);
+            }
+            pthread_mutex_unlock (&lock);
+        }
+        
+        void finish () {
+            // method to wait for the background thread to fill the next lists, if asked (call before the lists go away)
+            if (pending) {
+                pthread_mutex_lock (&lock);
+                while (busy) {
+                    pthread_cond_wait (&filled, &lock);
+                }
+                pthread_mutex_unlock (&lock);
+                pending = false;
+            }
+        }
+        
+        void fill_hashed (const tb_philox & rng, uint32_t step, uint32_t stream, int * ys_out, int * xs_out, int y0, int y1) const {
+            /* method to fill positions y0 * xdim up to y1 * xdim of a hashed sequence. Position
+            (y * xdim) + x holds the cell that the cell number (y << bx) | x hashes to, where the
+            hash is a Feistel network keyed by words 0 to hash_rounds - 1 of the stream (step,
+            stream). The network is a permutation of all numbers of 2 * half bits, so hashing again
+            until the result is a cell of the grid ('cycle walking') gives a permutation of the
+            cells. There are fewer than 8 numbers per cell, so this takes few walks, and the cells
+            come straight out of the bits with no division.
+            rng = the generator
+            step, stream = the stream for the keys
+            ys_out, xs_out = the lists to fill
+            y0, y1 = the rows of positions to fill
+            */
+            uint32_t keys[hash_rounds];
+            uint64_t c;                 // cell number
+            uint64_t x_mask = ((uint64_t)1 << bx) - 1;
+            size_t i = (size_t)y0 * xdim;
+            
+            rng.fill (step, stream, 0, hash_rounds, keys);
+            for (int y = y0; y < y1; y++) {
+                for (int x = 0; x < xdim; x++) {
+                    c = ((uint64_t)y << bx) | (uint64_t)x;
+                    do {
+                        c = feistel (c, keys);
+                    } while ((c >> bx) >= (uint64_t)ydim || (c & x_mask) >= (uint64_t)xdim);
+                    ys_out[i] = (int)(c >> bx);
+                    xs_out[i] = (int)(c & x_mask);
+                    i++;
+                }
+            }
+        }
+        
+        inline uint64_t feistel (uint64_t c, const uint32_t * keys) const {
+            /* method to hash a number of 2 * half bits to another (a permutation), with a balanced
+            Feistel network: each round swaps the halves and mixes a keyed hash of one into the other
+            c = the number
+            keys = the round keys
+            */
+            uint32_t l = (uint32_t)(c >> half) & half_mask;
+            uint32_t r = (uint32_t)c & half_mask;
+            uint32_t f;
+            
+            for (int k = 0; k < hash_rounds; k++) {
+                f = (r ^ keys[k]) * 0x9E3779B1;         // round function (a murmur3 style mix)
+                f = f ^ (f >> 16);
+                f = f * 0x85EBCA6B;
+                f = f ^ (f >> 13);
+                f = l ^ (f & half_mask);
+                l = r;
+                r = f;
+            }
+            return (((uint64_t)l << half) | r);
+        }
+        
+        void shuffle (const tb_philox & rng, uint32_t step, uint32_t stream, size_t start, size_t end) {
+            /* method to shuffle positions start up to end of the lists (Fisher-Yates), for fewer than
+            2^32 positions. Position i takes word i of the stream (step, stream) to pick a random
+            position from start up to i. The words are taken in batches (see tb_philox::fill),
+            working down from the end.
+            rng = the generator
+            step, stream = the stream for the draws
+            start, end = the positions to shuffle
+            */
+            uint32_t draws[batch];      // a batch of draws, draws[j] for position first + j
+            size_t first;               // the first position of the batch
+            size_t i = end;             // the position past the next to shuffle
+            
+            while (i > start) {
+                first = (i - start > batch) ? (i - batch) : start;
+                rng.fill (step, stream, first, i - first, draws);
+                for (; i > first; i--) {
+                    swap (i - 1, start + (draws[i - 1 - first] % (i - start)));     // a random position up to i - 1
+                }
+            }
+        }
+        
+        inline void swap (size_t i, size_t r) {
+            // method to swap the (y, x) pairs at positions i and r
+            int rval;           // the value to swap
+            rval = ys[r];                               // swap the y
+            ys[r] = ys[i];
+            ys[i] = rval;
+            rval = xs[r];                               // and the x
+            xs[r] = xs[i];
+            xs[i] = rval;
         }
 };
@@ -24,24 +24,68 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "tb_boundaries.hpp"            // generic boundaries class
 
-class tb_raster {
-    // generic raster class for spatial models
+template <class cell_t>
+class tb_raster_t {
+    /* generic raster class for spatial models. The cell values are stored as cell_t, which is
+    double for the plain tb_raster (see the typedef below), or can be float to halve the memory,
+    or a small integer type for masks. Calculations on the cells (sums, slopes, etc.) are carried
+    out in double.
+    
+    The memory is either taken from a shared arena (e.g., one arena for all the rasters of a model,
+    see tb_arena.hpp), or held by the raster itself. Either way it is freed with its owner, so a
+    raster can be moved but not copied: pass rasters by reference.
+    */
     public:
-        double ** ras;                      // raster values
+        cell_t ** ras;                      // raster values (row pointers into the block, valid from -1 to ydim)
+        cell_t ** ras_mem;                  // memory backing the row pointers
+        cell_t * block;                     // contiguous, aligned block holding all the rows and halos
+        cell_t * origin;                    // cell (0, 0) in the block
+        size_t block_len;                   // number of cells in the block (including halos and padding)
         int ydim;                           // nrows
         int xdim;                           // ncols
+        int stride;                         // row stride of the block in cells (>= xdim + 2)
         double yll_corner;                  // the lower left corner y coord
         double xll_corner;                  // the lower left corner x coord
         double cellsize;                    // cellsize
         double nodata_value;                // nodata value
         tb_boundaries b;                    // boundaries object (note this requires manual initialization)
+        tb_arena own;                       // memory for the raster if it is not in a shared arena
         
-        tb_raster () {
-            // constructor is simply a placeholder 
+        tb_raster_t () {
+            // constructor is simply a placeholder (the raster has no memory until init or read_ascii_raster)
+            ras = NULL;
+            ras_mem = NULL;
+            block = NULL;
+            origin = NULL;
+            block_len = 0;
+        }
+        
+        tb_raster_t (const tb_raster_t &) = delete;
+        tb_raster_t & operator= (const tb_raster_t &) = delete;
+        tb_raster_t (tb_raster_t &&) = default;
+        tb_raster_t & operator= (tb_raster_t &&) = default;
+        
+        static int calc_stride (int xdim_in) {
+            // row stride in cells: a cache line of padding, then the row and column xdim out to a cache line
+            int align_cells = (int)(64 / sizeof (cell_t));
+            return (align_cells + (((xdim_in + 1 + align_cells - 1) / align_cells) * align_cells));
+        }
+        
+        static size_t mem_size (int ydim_in, int xdim_in) {
+            // bytes of arena needed for a raster of these dimensions, including its boundaries (see init)
+            return (tb_arena::round ((size_t)(ydim_in + 2) * calc_stride (xdim_in) * sizeof (cell_t)) +
+                    tb_arena::round ((ydim_in + 2) * sizeof (cell_t *)) + tb_boundaries::mem_size (ydim_in, xdim_in));
+        }
+        
+        inline cell_t & operator() (int y, int x) {
+            /* direct access to a cell in the block, equivalent to ras[y][x] but without
+            the row pointer load
+            */
+            return (origin[((size_t)y * stride) + x]);
         }
                 
         void init (int ydim_in, int xdim_in, double yll_corner_in, double xll_corner_in, double cellsize_in,
-                   string boundaries_ns_in, string boundaries_ew_in) {
+                   string boundaries_ns_in, string boundaries_ew_in, tb_arena * arena = NULL, bool fill = true) {
             /* method to initialize the raster object directly
             
             ydim_in = the y dimensions of the raster
@@ -51,28 +95,100 @@ class tb_raster {
             cellsize_in = the cellsize of the raster
             boundaries_ns_in = the boundaries type for the north-south edges, either 'periodic' or 'nonperiodic'
             boundaries_ew_in = the boundaries type for the east-west edges, either 'periodic' or 'nonperiodic'
+            arena = a shared arena (sized with mem_size) to take the memory from, or NULL to allocate
+                the memory in this raster
+            fill = true to set the raster to nodata, or false to leave the memory untouched so it can
+                be first written by the threads that use it (see setnull_rows)
             */
             ydim = ydim_in;
             xdim = xdim_in;
             yll_corner = yll_corner_in;
             xll_corner = xll_corner_in;
             cellsize = cellsize_in;
-            nodata_value = -9999.0;
-            b.init (ydim, xdim, boundaries_ns_in, boundaries_ew_in);
-            allocate_mem ();
-            setnull ();
+            if (numeric_limits <cell_t>::is_integer) {
+                nodata_value = (double)numeric_limits <cell_t>::max ();     // -9999 does not fit (e.g., masks)
+            } else {
+                nodata_value = -9999.0;
+            }
+            if (arena == NULL) {
+                own.init (mem_size (ydim, xdim), false);
+                arena = &own;
+            }
+            b.init (ydim, xdim, boundaries_ns_in, boundaries_ew_in, arena);
+            allocate_mem (arena);
+            if (fill) {
+                setnull ();
+            }
         }
             
-        void allocate_mem () {
-            // method to allocate internal memory for the array
-            try {
-                ras = new double * [ydim];
-                for (int y = 0; y < ydim; y++) {
-                    ras[y] = new double [xdim];
+        void allocate_mem (tb_arena * arena) {
+            /* method to take the memory for the array from the arena. The raster is held in one
+            contiguous block aligned to a cache line (64 bytes). The block has a one cell halo
+            (ghost cells) around the raster: rows -1 and ydim, and columns -1 and xdim, which
+            are filled by refresh_halo. Each row is laid out as a cache line of padding (whose
+            last cell is column -1), the raster cells starting on a cache line, then column
+            xdim and padding out to a cache line. The ras row pointers index into the block so
+            the ras[y][x] access still works, including ras[-1] and ras[ydim].
+            
+            arena = the arena to take the memory from (see mem_size)
+            */
+            size_t align_cells = 64 / sizeof (cell_t);          // alignment in cells
+            
+            stride = calc_stride (xdim);
+            block_len = (size_t)(ydim + 2) * stride;
+            
+            block = arena->take <cell_t> (block_len);
+            ras_mem = arena->take <cell_t *> (ydim + 2);
+            
+            // set the row pointers
+            origin = block + stride + align_cells;
+            ras = ras_mem + 1;
+            for (int y = -1; y < ydim + 1; y++) {
+                ras[y] = origin + ((ptrdiff_t)y * stride);
+            }
+        }
+        
+        void refresh_halo () {
+            /* method to fill the halo cells around the raster from the edge cells, following the
+            boundary 'looking' rules: periodic edges wrap around, nonperiodic edges mirror the edge
+            cell (the same as the b.n1, b.s1, b.e1, and b.w1 lookups). Once the halo is refreshed,
+            a stencil can use plain y +/- 1 and x +/- 1 offsets from any raster cell. The halo must
+            be refreshed after the raster changes and before it is read with offsets.
+            */
+            bool periodic_ew = b.periodic_ew;
+            bool periodic_ns = b.periodic_ns;
+            
+            // east and west halo columns first
+            for (int y = 0; y < ydim; y++) {
+                if (periodic_ew) {
+                    ras[y][-1] = ras[y][xdim - 1];
+                    ras[y][xdim] = ras[y][0];
+                } else {
+                    ras[y][-1] = ras[y][0];
+                    ras[y][xdim] = ras[y][xdim - 1];
                 }
-            } catch(...) {
-                cout << "ERROR: cannot allocate sufficient memory!" << endl;
-                exit (10);
+            }
+            
+            // then the north and south halo rows, including the corners
+            cell_t * n_src = periodic_ns ? ras[0] : ras[ydim - 1];
+            cell_t * s_src = periodic_ns ? ras[ydim - 1] : ras[0];
+            for (int x = -1; x < xdim + 1; x++) {
+                ras[ydim][x] = n_src[x];
+                ras[-1][x] = s_src[x];
+            }
+        }
+        
+        void refresh_halo_row (int y) {
+            /* method to fill the east and west halo cells of row y from the edge cells (see
+            refresh_halo), for sweeps that change a row and then read it with x +/- 1 offsets
+            y = the row
+            */
+            if (b.periodic_ew) {
+                ras[y][-1] = ras[y][xdim - 1];
+                ras[y][xdim] = ras[y][0];
+            } else {
+                ras[y][-1] = ras[y][0];
+                ras[y][xdim] = ras[y][xdim - 1];
             }
         }
         
@@ -124,13 +240,17 @@ class tb_raster {
         }
 
         void read_ascii_raster (string infilename) {
-            /* method to read in an ascii raster
+            /* method to read in an ascii raster. If the raster has already been initialized, the
+            file must have the same dimensions and is read into the existing memory, else the
+            raster allocates its own memory for the file (with no boundaries set up).
             
             infilename = the name of the file to read in
             */
             
             int file_read_errorcode = 12;
             int fail_cntr;                      // counter to trigger file read failure
+            int file_xdim;                      // ncols in the file
+            int file_ydim;                      // nrows in the file
         
             if (verbose) {
                 cout << "Reading ascii raster file: " << infilename << endl;
@@ -156,7 +276,7 @@ class tb_raster {
                 }
             }
             while (read1 != "ncols" && read1 != "NCOLS");
-            ifile >> xdim;                  // next integer should be xdim or ncols
+            ifile >> file_xdim;             // next integer should be xdim or ncols
 
             // Search 2: look for the number of rows
             ifile.seekg (0);      // rewind to the beginning again
@@ -171,7 +291,7 @@ class tb_raster {
                 }
             }
             while (read2 != "nrows" && read2 != "NROWS");
-            ifile >> ydim;                  // next integer should be ydim or nrows
+            ifile >> file_ydim;             // next integer should be ydim or nrows
 
             // Search 3: look for the xllcorner
             ifile.seekg (0);      // rewind to the beginning again
@@ -233,8 +353,17 @@ class tb_raster {
             while (read6 != "nodata_value" && read6 != "NODATA_value" && read6 != "NODATA_VALUE");
             ifile >> nodata_value;          // next double should be nodata_value
             
-            // next, we need to allocate memory for the raster
-            allocate_mem ();
+            // next, we need memory for the raster, or to check the file fits the memory we have
+            if (origin == NULL) {
+                ydim = file_ydim;
+                xdim = file_xdim;
+                own.init (mem_size (ydim, xdim), false);
+                allocate_mem (&own);
+            } else if (file_ydim != ydim || file_xdim != xdim) {
+                cout << "ERROR: input file " << infilename << " is " << file_ydim << " x " << file_xdim <<
+                        ", expected " << ydim << " x " << xdim << endl;
+                exit (file_read_errorcode);
+            }
             
             // now, we can read in the contents of the raster into memory
             for (int y = (ydim - 1); y > -1; y--) {
@@ -250,9 +379,9 @@ class tb_raster {
             }   
         }
         
-        tb_raster calc_aspect_horn (tb_raster oput) {
-            /* method to calculate the aspect of the raster with the Horn (1981) method and
-            return a tb_raster object that is a copy of the present raster.
+        tb_raster_t & calc_aspect_horn (tb_raster_t & oput) {
+            /* method to calculate the aspect of the raster with the Horn (1981) method into
+            oput, and return a reference to oput.
             
             oput = a raster to update the cells
             
@@ -270,6 +399,7 @@ class tb_raster {
             }
             
             oput.setnull ();
+            refresh_halo ();
             
             for (int y = 0; y < ydim; y++) {
                 for (int x = 0; x < xdim; x++) {
@@ -280,11 +410,11 @@ class tb_raster {
                     double aspect_return;       // returned aspect in azimuth degrees
                     
                     // calculate the dz_dx and dz_dy values
-                    dz_dx = ((ras[b.n1[y]][b.e1[x]] + (2.0 * ras[y][b.e1[x]]) + ras[b.s1[y]][b.e1[x]] -
-                                ras[b.n1[y]][b.w1[x]] - (2.0 * ras[y][b.w1[x]]) - ras[b.s1[y]][b.w1[x]]) /
+                    dz_dx = ((ras[y + 1][x + 1] + (2.0 * ras[y][x + 1]) + ras[y - 1][x + 1] -
+                                ras[y + 1][x - 1] - (2.0 * ras[y][x - 1]) - ras[y - 1][x - 1]) /
                                 (8.0 * cellsize));
-                    dz_dy = ((ras[b.s1[y]][b.w1[x]] + (2.0 * ras[b.s1[y]][x]) + ras[b.s1[y]][b.e1[x]] -
-                                ras[b.n1[y]][b.w1[x]] - (2.0 * ras[b.n1[y]][x]) - ras[b.n1[y]][b.e1[x]]) / 
+                    dz_dy = ((ras[y - 1][x - 1] + (2.0 * ras[y - 1][x]) + ras[y - 1][x + 1] -
+                                ras[y + 1][x - 1] - (2.0 * ras[y + 1][x]) - ras[y + 1][x + 1]) / 
                                 (8.0 * cellsize));
                     
                     // assign -1 code to aspect if the location is flat
@@ -308,9 +438,9 @@ class tb_raster {
             return (oput);
         }
         
-        tb_raster calc_slope_horn (tb_raster oput) {
-            /* method to calculate the aspect of the raster with the Horn (1981) method and
-            return a tb_raster object that is a copy of the present raster.
+        tb_raster_t & calc_slope_horn (tb_raster_t & oput) {
+            /* method to calculate the aspect of the raster with the Horn (1981) method into
+            oput, and return a reference to oput.
             
             oput = a raster to update the cells
             
@@ -327,6 +457,7 @@ class tb_raster {
             }
 
             oput.setnull ();
+            refresh_halo ();
             
             for (int y = 0; y < ydim; y++) {
                 for (int x = 0; x < xdim; x++) {
@@ -337,11 +468,11 @@ class tb_raster {
                     double slope;               // returned slope in degrees
                     
                     // calculate the dz_dx and dz_dy values
-                    dz_dx = ((ras[b.n1[y]][b.e1[x]] + (2.0 * ras[y][b.e1[x]]) + ras[b.s1[y]][b.e1[x]] -
-                                ras[b.n1[y]][b.w1[x]] - (2.0 * ras[y][b.w1[x]]) - ras[b.s1[y]][b.w1[x]]) /
+                    dz_dx = ((ras[y + 1][x + 1] + (2.0 * ras[y][x + 1]) + ras[y - 1][x + 1] -
+                                ras[y + 1][x - 1] - (2.0 * ras[y][x - 1]) - ras[y - 1][x - 1]) /
                                 (8.0 * cellsize));
-                    dz_dy = ((ras[b.s1[y]][b.w1[x]] + (2.0 * ras[b.s1[y]][x]) + ras[b.s1[y]][b.e1[x]] -
-                                ras[b.n1[y]][b.w1[x]] - (2.0 * ras[b.n1[y]][x]) - ras[b.n1[y]][b.e1[x]]) / 
+                    dz_dy = ((ras[y - 1][x - 1] + (2.0 * ras[y - 1][x]) + ras[y - 1][x + 1] -
+                                ras[y + 1][x - 1] - (2.0 * ras[y + 1][x]) - ras[y + 1][x + 1]) / 
                                 (8.0 * cellsize));
                     
                     // calculate rise/run
@@ -359,7 +490,7 @@ class tb_raster {
             return (oput);        
         }
         
-        tb_raster calc_aspect_d8 (tb_raster oput) {
+        tb_raster_t & calc_aspect_d8 (tb_raster_t & oput) {
             /* method to calculate downhill aspect based on the d8 algorithm. This algorithm
             determines the steepest slope from the target cell to one of the eight adjacent
             cells.
@@ -374,6 +505,7 @@ class tb_raster {
             }
             
             oput.setnull ();
+            refresh_halo ();
 
             double aspect;                  // aspect to be assigned
             double diff;                    // rise / run diff
@@ -387,43 +519,43 @@ class tb_raster {
                     aspect = -1.0;
                     
                     // check N
-                    if ((ras[y][x] - ras[b.n1[y]][x]) / cellsize > diff) {
-                        diff = (ras[y][x] - ras[b.n1[y]][x]) / cellsize;
+                    if ((ras[y][x] - ras[y + 1][x]) / cellsize > diff) {
+                        diff = (ras[y][x] - ras[y + 1][x]) / cellsize;
                         aspect = 360.0;
                     }
                     // check NE
-                    if ((ras[y][x] - ras[b.n1[y]][b.e1[x]]) / angle_dist > diff) {
-                        diff = (ras[y][x] - ras[b.n1[y]][b.e1[x]]) / angle_dist;
+                    if ((ras[y][x] - ras[y + 1][x + 1]) / angle_dist > diff) {
+                        diff = (ras[y][x] - ras[y + 1][x + 1]) / angle_dist;
                         aspect = 45.0;
                     }
                     // check E
-                    if ((ras[y][x] - ras[y][b.e1[x]]) / cellsize > diff) {
-                        diff = (ras[y][x] - ras[y][b.e1[x]]) / cellsize;
+                    if ((ras[y][x] - ras[y][x + 1]) / cellsize > diff) {
+                        diff = (ras[y][x] - ras[y][x + 1]) / cellsize;
                         aspect = 90.0;
                     }
                     // check SE
-                    if ((ras[y][x] - ras[b.s1[y]][b.e1[x]]) / angle_dist > diff) {
-                        diff = (ras[y][x] - ras[b.s1[y]][b.e1[x]]) / angle_dist;
+                    if ((ras[y][x] - ras[y - 1][x + 1]) / angle_dist > diff) {
+                        diff = (ras[y][x] - ras[y - 1][x + 1]) / angle_dist;
                         aspect = 135.0;
                     }
                     // check S
-                    if ((ras[y][x] - ras[b.s1[y]][x]) / cellsize > diff) {
-                        diff = (ras[y][x] - ras[b.s1[y]][x]) / cellsize;
+                    if ((ras[y][x] - ras[y - 1][x]) / cellsize > diff) {
+                        diff = (ras[y][x] - ras[y - 1][x]) / cellsize;
                         aspect = 180.0;
                     }
                     // check SW
-                    if ((ras[y][x] - ras[b.s1[y]][b.w1[x]]) / angle_dist > diff) {
-                        diff = (ras[y][x] - ras[b.s1[y]][b.w1[x]]) / angle_dist;
+                    if ((ras[y][x] - ras[y - 1][x - 1]) / angle_dist > diff) {
+                        diff = (ras[y][x] - ras[y - 1][x - 1]) / angle_dist;
                         aspect = 225.0;
                     }
                     // check W
-                    if ((ras[y][x] - ras[y][b.w1[x]]) / cellsize > diff) {
-                        diff = (ras[y][x] - ras[y][b.w1[x]]) / cellsize;
+                    if ((ras[y][x] - ras[y][x - 1]) / cellsize > diff) {
+                        diff = (ras[y][x] - ras[y][x - 1]) / cellsize;
                         aspect = 270.0;
                     }
                     // check NW
-                    if ((ras[y][x] - ras[b.n1[y]][b.w1[x]]) / angle_dist > diff) {
-                        diff = (ras[y][x] - ras[b.n1[y]][b.w1[x]]) / angle_dist;
+                    if ((ras[y][x] - ras[y + 1][x - 1]) / angle_dist > diff) {
+                        diff = (ras[y][x] - ras[y + 1][x - 1]) / angle_dist;
                         aspect = 315.0;
                     }
 
@@ -433,7 +565,7 @@ class tb_raster {
             return (oput);
         }
         
-        tb_raster calc_slope_d8 (tb_raster oput) {
+        tb_raster_t & calc_slope_d8 (tb_raster_t & oput) {
             /* method to calculate downhill slope based on the d8 algorithm. This algorithm
             determines the steepest slope from the target cell to one of the eight adjacent
             cells.
@@ -448,6 +580,7 @@ class tb_raster {
             }
             
             oput.setnull ();
+            refresh_halo ();
             
             double diff;                    // rise / run diff
             double angle_dist;              // angle distance
@@ -459,36 +592,36 @@ class tb_raster {
                     diff = -99999999999.9;
                     
                     // check N
-                    if ((ras[y][x] - ras[b.n1[y]][x]) / cellsize > diff) {
-                        diff = (ras[y][x] - ras[b.n1[y]][x]) / cellsize;
+                    if ((ras[y][x] - ras[y + 1][x]) / cellsize > diff) {
+                        diff = (ras[y][x] - ras[y + 1][x]) / cellsize;
                     }
                     // check NE
-                    if ((ras[y][x] - ras[b.n1[y]][b.e1[x]]) / angle_dist > diff) {
-                        diff = (ras[y][x] - ras[b.n1[y]][b.e1[x]]) / angle_dist;
+                    if ((ras[y][x] - ras[y + 1][x + 1]) / angle_dist > diff) {
+                        diff = (ras[y][x] - ras[y + 1][x + 1]) / angle_dist;
                     }
                     // check E
-                    if ((ras[y][x] - ras[y][b.e1[x]]) / cellsize > diff) {
-                        diff = (ras[y][x] - ras[y][b.e1[x]]) / cellsize;
+                    if ((ras[y][x] - ras[y][x + 1]) / cellsize > diff) {
+                        diff = (ras[y][x] - ras[y][x + 1]) / cellsize;
                     }
                     // check SE
-                    if ((ras[y][x] - ras[b.s1[y]][b.e1[x]]) / angle_dist > diff) {
-                        diff = (ras[y][x] - ras[b.s1[y]][b.e1[x]]) / angle_dist;
+                    if ((ras[y][x] - ras[y - 1][x + 1]) / angle_dist > diff) {
+                        diff = (ras[y][x] - ras[y - 1][x + 1]) / angle_dist;
                     }
                     // check S
-                    if ((ras[y][x] - ras[b.s1[y]][x]) / cellsize > diff) {
-                        diff = (ras[y][x] - ras[b.s1[y]][x]) / cellsize;
+                    if ((ras[y][x] - ras[y - 1][x]) / cellsize > diff) {
+                        diff = (ras[y][x] - ras[y - 1][x]) / cellsize;
                     }
                     // check SW
-                    if ((ras[y][x] - ras[b.s1[y]][b.w1[x]]) / angle_dist > diff) {
-                        diff = (ras[y][x] - ras[b.s1[y]][b.w1[x]]) / angle_dist;
+                    if ((ras[y][x] - ras[y - 1][x - 1]) / angle_dist > diff) {
+                        diff = (ras[y][x] - ras[y - 1][x - 1]) / angle_dist;
                     }
                     // check W
-                    if ((ras[y][x] - ras[y][b.w1[x]]) / cellsize > diff) {
-                        diff = (ras[y][x] - ras[y][b.w1[x]]) / cellsize;
+                    if ((ras[y][x] - ras[y][x - 1]) / cellsize > diff) {
+                        diff = (ras[y][x] - ras[y][x - 1]) / cellsize;
                     }
                     // check NW
-                    if ((ras[y][x] - ras[b.n1[y]][b.w1[x]]) / angle_dist > diff) {
-                        diff = (ras[y][x] - ras[b.n1[y]][b.w1[x]]) / angle_dist;
+                    if ((ras[y][x] - ras[y + 1][x - 1]) / angle_dist > diff) {
+                        diff = (ras[y][x] - ras[y + 1][x - 1]) / angle_dist;
                     }
                     
                     // check the difference is not 0.0 and assign
@@ -507,52 +640,93 @@ class tb_raster {
             when a fresh raster is desired. The nodata value should obviously mess up
             calculations with the raster and highlight the error
             */
-            for (int y = 0; y < ydim; y++) {
-                for (int x = 0; x < xdim; x++) {
-                    ras[y][x] = nodata_value;
-                }
+            for (size_t i = 0; i < block_len; i++) {
+                block[i] = nodata_value;                    // includes the halo
             }
         }
             
         void setvalue (double value) {
-            /* method to set the raster to one value
+            /* method to set the raster to one value (including the halo)
             value = the value to set
             */
-            for (int y = 0; y < ydim; y++) {
-                for (int x = 0; x < xdim; x++) {
-                    ras[y][x] = value;
-                }
+            for (size_t i = 0; i < block_len; i++) {
+                block[i] = value;
             }
         }
         
-        void bumpify (double multiplier) {
+        void setvalue_rows (double value, int y0, int y1) {
+            /* method to set a band of rows to one value, including the padding and halo cells of the
+            rows. The band at the bottom (y0 = 0) also sets halo row -1 and the band at the top
+            (y1 = ydim) sets halo row ydim, so bands that cover the rows cover the whole block.
+            value = the value to set
+            y0 = the first row of the band
+            y1 = the row after the last row of the band
+            */
+            if (y1 <= y0) {
+                return;                     // empty band (more bands than rows)
+            }
+            size_t first = (size_t)((y0 == 0) ? 0 : y0 + 1) * stride;
+            size_t last = (size_t)((y1 == ydim) ? ydim + 2 : y1 + 1) * stride;
+            for (size_t i = first; i < last; i++) {
+                block[i] = value;
+            }
+        }
+        
+        void setnull_rows (int y0, int y1) {
+            // method to set a band of rows to nodata (see setvalue_rows)
+            setvalue_rows (nodata_value, y0, y1);
+        }
+        
+        void band_span (int y0, int y1, char * & p, size_t & len) {
+            // method to return the memory of a band of rows (see setvalue_rows)
+            if (y1 <= y0) {
+                p = (char *)block;
+                len = 0;
+                return;
+            }
+            size_t first = (size_t)((y0 == 0) ? 0 : y0 + 1) * stride;
+            size_t last = (size_t)((y1 == ydim) ? ydim + 2 : y1 + 1) * stride;
+            p = (char *)(block + first);
+            len = (last - first) * sizeof (cell_t);
+        }
+        
+        void bumpify (double multiplier, tb_philox_stream & rs) {
             /* method to randomly add or subtract small amounts with a uniform dist to
-            the raster values to make the raster surface bumpy, note that
-            the mersenne twister functions must be part of the global scope
+            the raster values to make the raster surface bumpy
             multiplier = value to multiply against random draws from -0.5 to 0.5 to add
+            rs = the random stream to draw from, word (y * xdim) + x is the draw for cell y, x
             */
             for (int y = 0; y < ydim; y++) {
                 for (int x = 0; x < xdim; x++) {
                     if (ras[y][x] != nodata_value) {
-                        ras[y][x] = ras[y][x] + (multiplier * (genrand_real1() - 0.5));
+                        ras[y][x] = ras[y][x] + (multiplier * (tb_philox::real1 (rs (((uint64_t)y * xdim) + x)) - 0.5));
                     }
                 }
             }
         }    
         
-        void copy_rastercells (tb_raster in_raster) {
+        void copy_rastercells (tb_raster_t & in_raster) {
             /* method to copy all the cells from another raster (with identical dimensions).
             Note that this only copies raster cells, not any spatial metadata or anything
             else!
             
             in_raster = another instance of a tb_raster
             */
+            copy_rastercells (in_raster, 0, ydim);
+        }
+        
+        void copy_rastercells (tb_raster_t & in_raster, int y0, int y1) {
+            /* method to copy the cells in a band of rows from another raster (see copy_rastercells)
+            in_raster = another instance of a tb_raster
+            y0 = the first row of the band
+            y1 = the row after the last row of the band
+            */
             if (in_raster.xdim != xdim || in_raster.ydim != ydim) {
                 cout << "ERROR: copy_values method requires conformant rasters" << endl;
                 exit (10);
             }
             // copy the values
-            for (int y = 0; y < ydim; y++) {
+            for (int y = y0; y < y1; y++) {
                 for (int x = 0; x < xdim; x++) {
                     if (in_raster.ras[y][x] == in_raster.nodata_value) {
                         ras[y][x] = nodata_value;
@@ -618,11 +792,11 @@ class tb_raster {
             return (max);
         }
         
-        int num_NAs () {
+        size_t num_NAs () {
             /* method to count the number of NAs in the raster
             */
             
-            int num_NAs;
+            size_t num_NAs;
             num_NAs = 0;
             
             for (int y = 0; y < ydim; y++) {
@@ -646,10 +820,10 @@ class tb_raster {
             number_NAs = (double)num_NAs ();
             sumval = sum ();
             
-            if (number_NAs == (ydim * xdim)) {
+            if (number_NAs == ((double)ydim * xdim)) {
                 meanval = nodata_value;
             } else {
-                meanval = sumval / ((ydim * xdim) - number_NAs);
+                meanval = sumval / (((double)ydim * xdim) - number_NAs);
             }
             return (meanval);
         }
@@ -661,7 +835,7 @@ class tb_raster {
             cout << "==============================================" << endl;
         }
 
-        tb_raster rooks_filter (tb_raster oput) {
+        tb_raster_t & rooks_filter (tb_raster_t & oput) {
             /* method to filter the raster and populate the oput raster
             with the results. This filter is a mean of the 4 nearest cells
             and target cell or 'rooks case'. This eventually may be replaced with
@@ -674,6 +848,7 @@ class tb_raster {
             int neigh_count;                // the count of neighbors
             
             oput.setnull ();
+            refresh_halo ();
             
             for (int y = 0; y < ydim; y++) {
                 for (int x = 0; x < xdim; x++) {
@@ -687,20 +862,20 @@ class tb_raster {
                     }
 
                     // rooks case cells
-                    if (ras[b.n1[y]][x] != nodata_value) {
-                        neigh_sum = neigh_sum + ras[b.n1[y]][x];
+                    if (ras[y + 1][x] != nodata_value) {
+                        neigh_sum = neigh_sum + ras[y + 1][x];
                         neigh_count++;
                     }
-                    if (ras[b.s1[y]][x] != nodata_value) {
-                        neigh_sum = neigh_sum + ras[b.s1[y]][x];
+                    if (ras[y - 1][x] != nodata_value) {
+                        neigh_sum = neigh_sum + ras[y - 1][x];
                         neigh_count++;
                     }
-                    if (ras[y][b.e1[x]] != nodata_value) {
-                        neigh_sum = neigh_sum + ras[y][b.e1[x]];
+                    if (ras[y][x + 1] != nodata_value) {
+                        neigh_sum = neigh_sum + ras[y][x + 1];
                         neigh_count++;
                     }
-                    if (ras[y][b.w1[x]] != nodata_value) {
-                        neigh_sum = neigh_sum + ras[y][b.w1[x]];
+                    if (ras[y][x - 1] != nodata_value) {
+                        neigh_sum = neigh_sum + ras[y][x - 1];
                         neigh_count++;
                     }
                     
@@ -714,7 +889,7 @@ class tb_raster {
             return (oput);
         }
             
-        tb_raster queens_filter (tb_raster oput) {
+        tb_raster_t & queens_filter (tb_raster_t & oput) {
             /* method to filter the raster and populate the oput raster
             with the results. This filter is a mean of the 8 nearest cells
             and target cell or 'queens case'. This eventually may be replaced with
@@ -727,6 +902,7 @@ class tb_raster {
             int neigh_count;                // the count of neighbors
             
             oput.setnull ();
+            refresh_halo ();
             
             for (int y = 0; y < ydim; y++) {
                 for (int x = 0; x < xdim; x++) {
@@ -740,38 +916,38 @@ class tb_raster {
                     }
                     
                     // rooks case cells
-                    if (ras[b.n1[y]][x] != nodata_value) {
-                        neigh_sum = neigh_sum + ras[b.n1[y]][x];
+                    if (ras[y + 1][x] != nodata_value) {
+                        neigh_sum = neigh_sum + ras[y + 1][x];
                         neigh_count++;
                     }
-                    if (ras[b.s1[y]][x] != nodata_value) {
-                        neigh_sum = neigh_sum + ras[b.s1[y]][x];
+                    if (ras[y - 1][x] != nodata_value) {
+                        neigh_sum = neigh_sum + ras[y - 1][x];
                         neigh_count++;
                     }
-                    if (ras[y][b.e1[x]] != nodata_value) {
-                        neigh_sum = neigh_sum + ras[y][b.e1[x]];
+                    if (ras[y][x + 1] != nodata_value) {
+                        neigh_sum = neigh_sum + ras[y][x + 1];
                         neigh_count++;
                     }
-                    if (ras[y][b.w1[x]] != nodata_value) {
-                        neigh_sum = neigh_sum + ras[y][b.w1[x]];
+                    if (ras[y][x - 1] != nodata_value) {
+                        neigh_sum = neigh_sum + ras[y][x - 1];
                         neigh_count++;
                     }
                     
                     // oblique corner cells
-                    if (ras[b.n1[y]][b.e1[x]] != nodata_value) {
-                        neigh_sum = neigh_sum + ras[b.n1[y]][b.e1[x]];
+                    if (ras[y + 1][x + 1] != nodata_value) {
+                        neigh_sum = neigh_sum + ras[y + 1][x + 1];
                         neigh_count++;
                     }
-                    if (ras[b.n1[y]][b.w1[x]] != nodata_value) {
-                        neigh_sum = neigh_sum + ras[b.n1[y]][b.w1[x]];
+                    if (ras[y + 1][x - 1] != nodata_value) {
+                        neigh_sum = neigh_sum + ras[y + 1][x - 1];
                         neigh_count++;
                     }
-                    if (ras[b.s1[y]][b.e1[x]] != nodata_value) {
-                        neigh_sum = neigh_sum + ras[b.s1[y]][b.e1[x]];
+                    if (ras[y - 1][x + 1] != nodata_value) {
+                        neigh_sum = neigh_sum + ras[y - 1][x + 1];
                         neigh_count++;
                     }
-                    if (ras[b.s1[y]][b.w1[x]] != nodata_value) {
-                        neigh_sum = neigh_sum + ras[b.s1[y]][b.w1[x]];
+                    if (ras[y - 1][x - 1] != nodata_value) {
+                        neigh_sum = neigh_sum + ras[y - 1][x - 1];
                         neigh_count++;
                     }
                     
@@ -786,6 +962,4 @@ class tb_raster {
         }
 };
 
-
-
-
+typedef tb_raster_t <double> tb_raster;    // raster of doubles
@@ -0,0 +1,299 @@
+// tb_tasks - task graph over bands of rows for model simulations
+// Thomas E. Barchyn - University of Calgary, Calgary, AB, Canada
+
+/*
+Copyright 2015-2016 Thomas E. Barchyn
+Contact: Thomas E. Barchyn [tbarchyn@gmail.com]
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+Please familiarize yourself with the license of this tool, available
+in the distribution with the filename: license.txt
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Task graphs: tb_threads runs a job over the whole grid and waits for every band before the next
+job starts, so each phase of a timestep waits for the slowest band of the phase before. Here the
+rows are cut into many small bands, and each phase on each band is a task. Task (p, k) (phase p
+on band k) only waits for phase p - 1 on the bands within reach[p] of band k: the bands whose
+rows it reads, or whose tasks read the rows it writes. So a band can go on to its next phase
+while bands further away are still on the phase before, with no barrier between the phases.
+
+The ready tasks are kept in a queue for each thread. A thread runs the newest task in its own
+queue first (its rows are likely still in cache), and when its queue is empty takes the oldest
+task from the queue of another thread (work stealing), so bands that take longer (e.g., more
+cells in contact) are evened out across the threads. The tasks of a phase write only their own
+band, so the results do not depend on the number of threads or the order the tasks run in.
+A thread with no task ready waits as the threads of tb_threads wait between jobs: it spins for
+a short while (the task it waits for is usually a band away from finishing) and then sleeps
+until tasks are queued. The task lists are set up in init, so a timestep allocates nothing.
+*/
+
+#include <atomic>
+
+struct tb_task_queue {
+    // ready tasks of one thread (see tb_tasks), padded so the locks of two threads do not share a cache line
+    pthread_mutex_t lock;
+    vector <int> tasks;                 // room for every task, so a run never reallocates
+    int head;                           // oldest task (taken by other threads)
+    int tail;                           // one past the newest task (taken by this thread)
+    vector <int> near;                  // bands near a band, for this thread (see near_bands)
+    char pad[64];
+};
+
+class tb_tasks {
+    public:
+        int ydim;                           // number of rows in the grid
+        int rows;                           // rows in a band (the last band can be shorter)
+        int bands;                          // number of bands
+        int phases;                         // number of phases
+        bool cyclic;                        // true if the first and last bands are neighbours (periodic)
+        vector <int> reach;                 // bands each phase waits for on each side, in the phase before
+        int max_reach;                      // the largest reach
+        vector <atomic <int> > pending;     // tasks each task is still waiting for
+        vector <tb_task_queue> queues;      // ready tasks of each thread
+        atomic <int> remaining;             // tasks not yet run
+        
+        pthread_mutex_t lock;               // lock for sleeping and waking
+        pthread_cond_t ready;               // signalled when tasks are queued, or the last task is complete
+        atomic <unsigned> posted;           // counts the queued tasks, a sleeping thread wakes when this changes
+        atomic <int> sleeping;              // threads sleeping on ready
+
+        tb_tasks () {
+            // constructor is a placeholder, must call init
+            ydim = 0;
+            rows = 1;
+            bands = 0;
+            phases = 0;
+            cyclic = false;
+            max_reach = 0;
+            remaining.store (0);
+            posted.store (0);
+            sleeping.store (0);
+            pthread_mutex_init (&lock, NULL);
+            pthread_cond_init (&ready, NULL);
+        }
+
+        ~tb_tasks () {
+            free_queues ();
+            pthread_mutex_destroy (&lock);
+            pthread_cond_destroy (&ready);
+        }
+
+        void init (int ydim_in, int rows_in, int phases_in, const int * reach_in, bool cyclic_in, int threads) {
+            /* method to set up the graph, and the task lists and queues. These are only reallocated
+            when the number of tasks, the reach or the number of threads changes (e.g., with ydim),
+            so a run allocates nothing.
+            ydim_in = the number of rows in the grid
+            rows_in = the rows in a band
+            phases_in = the number of phases
+            reach_in = the bands each phase waits for on each side (reach_in[0] is not used)
+            cyclic_in = true if the first and last bands are neighbours
+            threads = the number of threads (see tb_threads)
+            */
+            int old_tasks = (int)pending.size ();
+            int old_reach = max_reach;
+            
+            ydim = ydim_in;
+            rows = (rows_in < 1) ? 1 : rows_in;
+            bands = (ydim + rows - 1) / rows;
+            phases = phases_in;
+            cyclic = cyclic_in;
+            reach.assign (reach_in, reach_in + phases);
+            max_reach = 0;
+            for (int p = 1; p < phases; p++) {
+                max_reach = (reach[p] > max_reach) ? reach[p] : max_reach;
+            }
+            
+            if (phases * bands != old_tasks) {
+                pending = vector <atomic <int> > ((size_t)phases * bands);
+            }
+            if ((int)queues.size () != threads) {
+                free_queues ();
+                queues = vector <tb_task_queue> (threads);
+                for (int i = 0; i < threads; i++) {
+                    pthread_mutex_init (&queues[i].lock, NULL);
+                }
+                old_tasks = -1;             // the new queues need their lists
+            }
+            if (phases * bands != old_tasks || max_reach != old_reach) {
+                for (int i = 0; i < threads; i++) {
+                    queues[i].tasks.assign ((size_t)phases * bands, 0);
+                    queues[i].near.assign ((2 * max_reach) + 1, 0);
+                    queues[i].head = 0;
+                    queues[i].tail = 0;
+                }
+            }
+        }
+
+        void free_queues () {
+            // method to destroy the locks of the queues
+            for (size_t i = 0; i < queues.size (); i++) {
+                pthread_mutex_destroy (&queues[i].lock);
+            }
+            queues.clear ();
+        }
+
+        void band (int k, int & y0, int & y1) {
+            /* method to return the rows of band k, from y0 up to (but not including) y1
+            k = the band index
+            */
+            y0 = k * rows;
+            y1 = (y0 + rows < ydim) ? (y0 + rows) : ydim;
+        }
+
+        int near_bands (int k, int r, int * out) {
+            /* method to list the bands within r of band k (each once), and return how many
+            k = the band index
+            r = the reach
+            out = the bands (room for 2r + 1)
+            */
+            int count = 0;
+            if (cyclic && (2 * r) + 1 >= bands) {
+                for (int j = 0; j < bands; j++) {
+                    out[count++] = j;
+                }
+                return (count);
+            }
+            for (int j = k - r; j <= k + r; j++) {
+                if (cyclic) {
+                    out[count++] = (j + bands) % bands;
+                } else if (j >= 0 && j < bands) {
+                    out[count++] = j;
+                }
+            }
+            return (count);
+        }
+
+        template <class job_t>
+        void run (tb_threads & th, job_t job) {
+            /* method to run every phase on every band, and return when all the tasks are complete.
+            The job is called as job (p, y0, y1, i) for phase p on the rows y0 up to y1, on thread i.
+            th = the threads (as many as in init)
+            job = the job (e.g., a lambda)
+            */
+            int * near = &queues[0].near[0];
+
+            // the tasks of the first phase are ready, handed out as the bands of tb_threads
+            for (int p = 1; p < phases; p++) {
+                for (int k = 0; k < bands; k++) {
+                    pending[((size_t)p * bands) + k].store (near_bands (k, reach[p], near));
+                }
+            }
+            for (int i = 0; i < th.n; i++) {
+                queues[i].head = 0;
+                queues[i].tail = 0;
+            }
+            for (int k = bands - 1; k >= 0; k--) {
+                tb_task_queue & q = queues[(int)(((long long)k * th.n) / bands)];
+                q.tasks[q.tail++] = k;
+            }
+            remaining.store (phases * bands);
+
+            th.run (th.n, [&] (int, int, int i) {
+                work (th, i, job);
+            });
+        }
+
+        template <class job_t>
+        void work (tb_threads & th, int i, job_t & job) {
+            /* method to run tasks on thread i until every task is complete (see run). With no task
+            ready, the thread spins for a short while and then sleeps until tasks are queued, as the
+            threads of tb_threads wait for a job.
+            th = the threads
+            i = the thread index
+            job = the job
+            */
+            int n = th.n;
+            int * near = &queues[i].near[0];
+            int task, p, k, y0, y1, count;
+            unsigned seen;
+
+            while (remaining.load () > 0) {
+                task = -1;
+                seen = posted.load ();
+
+                // the newest task of this thread, or the oldest of another
+                pthread_mutex_lock (&queues[i].lock);
+                if (queues[i].tail > queues[i].head) {
+                    task = queues[i].tasks[--queues[i].tail];
+                }
+                pthread_mutex_unlock (&queues[i].lock);
+                for (int j = 1; j < n && task < 0; j++) {
+                    tb_task_queue & q = queues[(i + j) % n];
+                    pthread_mutex_lock (&q.lock);
+                    if (q.tail > q.head) {
+                        task = q.tasks[q.head++];
+                    }
+                    pthread_mutex_unlock (&q.lock);
+                }
+                if (task < 0) {
+                    wait_ready (th.spin_limit, seen);   // nothing ready, wait for tasks to be queued
+                    continue;
+                }
+
+                p = task / bands;
+                k = task % bands;
+                band (k, y0, y1);
+                job (p, y0, y1, i);
+
+                // release the tasks of the next phase that were waiting for this one
+                bool queued = false;
+                if (p + 1 < phases) {
+                    count = near_bands (k, reach[p + 1], near);
+                    for (int j = 0; j < count; j++) {
+                        int next = ((p + 1) * bands) + near[j];
+                        if (pending[next].fetch_sub (1) == 1) {
+                            pthread_mutex_lock (&queues[i].lock);
+                            queues[i].tasks[queues[i].tail++] = next;
+                            pthread_mutex_unlock (&queues[i].lock);
+                            queued = true;
+                        }
+                    }
+                }
+                if (remaining.fetch_sub (1) == 1 || queued) {
+                    wake_ready ();
+                }
+            }
+        }
+
+        void wait_ready (int spin_limit, unsigned seen) {
+            /* method to wait, spinning and then sleeping, until tasks are queued after seen (see
+            posted) or every task is complete
+            spin_limit = spins before sleeping (see tb_threads)
+            seen = posted when the thread last looked in the queues
+            */
+            for (int s = 0; s < spin_limit && posted.load () == seen && remaining.load () > 0; s++) {
+                TB_SPIN_PAUSE ();
+            }
+            if (posted.load () == seen && remaining.load () > 0) {
+                pthread_mutex_lock (&lock);
+                sleeping.fetch_add (1);
+                while (posted.load () == seen && remaining.load () > 0) {
+                    pthread_cond_wait (&ready, &lock);
+                }
+                sleeping.fetch_sub (1);
+                pthread_mutex_unlock (&lock);
+            }
+        }
+
+        void wake_ready () {
+            // method to count queued tasks (or the last task complete), and wake any sleeping threads
+            posted.fetch_add (1);
+            if (sleeping.load () > 0) {
+                pthread_mutex_lock (&lock);
+                pthread_cond_broadcast (&ready);
+                pthread_mutex_unlock (&lock);
+            }
+        }
+};
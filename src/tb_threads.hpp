@@ -0,0 +1,300 @@
+// tb_threads - row band threading for model simulations
+// Thomas E. Barchyn - University of Calgary, Calgary, AB, Canada
+
+/*
+Copyright 2015-2016 Thomas E. Barchyn
+Contact: Thomas E. Barchyn [tbarchyn@gmail.com]
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+Please familiarize yourself with the license of this tool, available
+in the distribution with the filename: license.txt
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+// pause in spin loops (lets the other hyperthread of the core run)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TB_SPIN_PAUSE() __builtin_ia32_pause ()
+#else
+#define TB_SPIN_PAUSE()
+#endif
+
+class tb_threads;
+
+struct tb_threads_worker {
+    // a thread of the pool and its index (see tb_threads::work)
+    tb_threads * pool;
+    int i;
+};
+
+class tb_threads {
+    /* This class splits the rows of a grid into one contiguous band per thread, and runs jobs
+    over the bands with one thread per band. The bands only depend on the number of rows and
+    threads, so thread i gets the same rows in every job. This matters for memory placement:
+    the thread that first writes a page of a raster is usually the thread whose memory the page
+    lands in, so rasters should be first written with the same bands as they are used.
+
+    The threads are started once (in init) and wait between jobs, as the small grids run tens of
+    thousands of iterations of a few jobs each, and starting threads for every job would take
+    longer than the jobs. A waiting thread spins for a short while (a job usually follows within
+    microseconds) and then sleeps until the next job (so a model stopped elsewhere, e.g., writing
+    outputs, does not hold the cpus). With more threads than cpus the threads sleep straight away,
+    as spinning would only hold up the thread with the work. The cpus are those the process is
+    allowed to run on (e.g., under taskset or a cpuset), and threads 1 and up can be pinned to one
+    of these each, so they keep their caches and memory node. Pinning is off by default, as two
+    runs on one computer would be pinned to the same cpus. The calling thread runs band 0 and is
+    left free, as it also starts other threads (e.g., tb_poll) that take its cpus.
+
+    Jobs must be run from one thread at a time (the model's main thread).
+    */
+
+    public:
+        int n;                              // number of threads (and bands)
+        bool pinned;                        // true if threads 1 and up are pinned to cpus
+        int spin_limit;                     // spins before a waiting thread sleeps
+
+        vector <pthread_t> threads;         // threads 1 to n - 1 (thread 0 is the caller)
+        vector <tb_threads_worker> workers; // the index of each thread
+        pthread_mutex_t lock;               // lock for sleeping and waking
+        pthread_cond_t wake;                // signalled when a job starts
+        pthread_cond_t done;                // signalled when the last thread finishes a job
+        atomic <unsigned> generation;       // counts the jobs, a thread starts a job when this changes
+        atomic <int> running;               // threads still running the present job
+        bool quit;                          // true to stop the threads (with a new generation)
+
+        void (*call) (void *, int, int, int);   // the present job (see call_job)
+        void * job_ptr;
+        int job_ydim;
+
+        static const int spins = 4000;      // spins before sleeping, with a cpu per thread (a few hundred microseconds)
+
+        tb_threads () {
+            // constructor sets a single thread, call init to change
+            n = 1;
+            pinned = false;
+            spin_limit = 0;
+            generation.store (0);
+            running.store (0);
+            quit = false;
+            call = NULL;
+            job_ptr = NULL;
+            job_ydim = 0;
+            pthread_mutex_init (&lock, NULL);
+            pthread_cond_init (&wake, NULL);
+            pthread_cond_init (&done, NULL);
+        }
+
+        ~tb_threads () {
+            // stop the threads
+            stop ();
+            pthread_mutex_destroy (&lock);
+            pthread_cond_destroy (&wake);
+            pthread_cond_destroy (&done);
+        }
+
+        void init (int n_in, bool pin = false) {
+            /* method to set the number of threads and start threads 1 to n - 1
+            n_in = the number of threads
+            pin = true to pin thread i to the i-th cpu the process is allowed (wrapping around the cpus)
+            */
+            if (n_in < 1) {
+                cout << "ERROR: the number of threads must be 1 or more" << endl;
+                exit (10);
+            }
+            stop ();
+            n = n_in;
+            vector <int> cpu_list;
+            int cpus = tb_cpus (&cpu_list);
+            spin_limit = (n <= cpus) ? spins : 0;
+            pinned = false;
+
+            threads.resize (n);
+            workers.resize (n);
+            for (int i = 1; i < n; i++) {
+                workers[i].pool = this;
+                workers[i].i = i;
+                if (pthread_create (&threads[i], NULL, &tb_threads::start, &workers[i]) != 0) {
+                    cout << "ERROR: cannot start thread " << i << endl;
+                    exit (10);
+                }
+            }
+            if (pin && n > 1 && !cpu_list.empty ()) {
+                pinned = true;
+                for (int i = 1; i < n; i++) {
+                    pinned = pin_thread (threads[i], cpu_list[i % cpu_list.size ()]) && pinned;
+                }
+            }
+        }
+
+        void stop () {
+            // method to stop threads 1 to n - 1 (if they are running)
+            if (n > 1 && (int)threads.size () == n) {
+                pthread_mutex_lock (&lock);
+                quit = true;
+                generation.fetch_add (1);
+                pthread_cond_broadcast (&wake);
+                pthread_mutex_unlock (&lock);
+                for (int i = 1; i < n; i++) {
+                    pthread_join (threads[i], NULL);
+                }
+                quit = false;
+            }
+            threads.clear ();
+            n = 1;
+        }
+
+        static int tb_cpus (vector <int> * cpu_list = NULL) {
+            /* function to return the number of cpus the process is allowed to run on (1 if not known)
+            cpu_list = if not NULL, set to the allowed cpus in order (left empty if not known)
+            */
+            int cpus = 0;
+            #ifdef __linux__
+            cpu_set_t set;
+            CPU_ZERO (&set);
+            if (sched_getaffinity (0, sizeof (set), &set) == 0) {
+                for (int c = 0; c < CPU_SETSIZE; c++) {
+                    if (CPU_ISSET (c, &set)) {
+                        if (cpu_list != NULL) {
+                            cpu_list->push_back (c);
+                        }
+                        cpus++;
+                    }
+                }
+            }
+            if (cpus == 0) {
+                cpus = (int)sysconf (_SC_NPROCESSORS_ONLN);
+            }
+            #endif
+            return ((cpus > 0) ? cpus : 1);
+        }
+
+        static bool pin_thread (pthread_t thread, int cpu) {
+            /* function to pin a thread to a cpu, returns false if this failed (or is not supported)
+            thread = the thread
+            cpu = the cpu
+            */
+            #ifdef __linux__
+            cpu_set_t set;
+            CPU_ZERO (&set);
+            CPU_SET (cpu, &set);
+            return (pthread_setaffinity_np (thread, sizeof (set), &set) == 0);
+            #else
+            return (false);
+            #endif
+        }
+
+        void band (int ydim, int i, int & y0, int & y1) {
+            /* method to return the rows of band i, from y0 up to (but not including) y1
+            ydim = the number of rows in the grid
+            i = the band (thread) index
+            */
+            y0 = (int)(((long long)ydim * i) / n);
+            y1 = (int)(((long long)ydim * (i + 1)) / n);
+        }
+
+        template <class job_t>
+        static void call_job (void * job, int y0, int y1, int i) {
+            // function to call a job of type job_t (the threads only see a pointer to the job)
+            (*(job_t *)job) (y0, y1, i);
+        }
+
+        template <class job_t>
+        void run (int ydim, job_t job) {
+            /* method to run a job over the bands, and return when all the bands are complete. The
+            job is called as job (y0, y1, i) for band i. Band 0 runs on the calling thread.
+            ydim = the number of rows in the grid
+            job = the job (e.g., a lambda)
+            */
+            int y0, y1;
+
+            if (n == 1) {
+                job (0, ydim, 0);
+                return;
+            }
+
+            // hand out the job, and wake any threads that are sleeping
+            call = &call_job <job_t>;
+            job_ptr = &job;
+            job_ydim = ydim;
+            running.store (n - 1);
+            pthread_mutex_lock (&lock);
+            generation.fetch_add (1);
+            pthread_cond_broadcast (&wake);
+            pthread_mutex_unlock (&lock);
+
+            band (ydim, 0, y0, y1);
+            job (y0, y1, 0);
+
+            // wait for the other bands, spinning and then sleeping
+            for (int s = 0; s < spin_limit && running.load () > 0; s++) {
+                TB_SPIN_PAUSE ();
+            }
+            if (running.load () > 0) {
+                pthread_mutex_lock (&lock);
+                while (running.load () > 0) {
+                    pthread_cond_wait (&done, &lock);
+                }
+                pthread_mutex_unlock (&lock);
+            }
+        }
+
+        static void * start (void * arg) {
+            // start function of threads 1 to n - 1
+            tb_threads_worker * w = (tb_threads_worker *)arg;
+            w->pool->work (w->i);
+            return (NULL);
+        }
+
+        void work (int i) {
+            /* method to run the jobs on thread i, until stop
+            i = the thread index
+            */
+            unsigned seen = 0;
+            int y0, y1;
+
+            while (true) {
+                // wait for the next job, spinning and then sleeping
+                for (int s = 0; s < spin_limit && generation.load () == seen; s++) {
+                    TB_SPIN_PAUSE ();
+                }
+                if (generation.load () == seen) {
+                    pthread_mutex_lock (&lock);
+                    while (generation.load () == seen) {
+                        pthread_cond_wait (&wake, &lock);
+                    }
+                    pthread_mutex_unlock (&lock);
+                }
+                seen = generation.load ();
+                if (quit) {
+                    return;
+                }
+
+                band (job_ydim, i, y0, y1);
+                (*call) (job_ptr, y0, y1, i);
+
+                // the last thread to finish wakes the caller, if it is sleeping
+                if (running.fetch_sub (1) == 1) {
+                    pthread_mutex_lock (&lock);
+                    pthread_cond_signal (&done);
+                    pthread_mutex_unlock (&lock);
+                }
+            }
+        }
+};
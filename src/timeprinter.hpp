@@ -62,3 +62,11 @@ class time_printer {
             }
         }
 };
+
+double wall_clock () {
+    /* function to return the wall clock time in seconds, for timing sections of the model
+    */
+    timeval tm;
+    gettimeofday (&tm, NULL);
+    return ((double)tm.tv_sec + ((double)tm.tv_usec * 1.0e-6));
+}
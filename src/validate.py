@@ -0,0 +1,253 @@
+# STAB: subglacial till advection and bedforms
+# Thomas E. Barchyn - University of Calgary, Calgary, AB, Canada
+
+# Copyright 2014-2016 Thomas E. Barchyn
+# Contact: Thomas E. Barchyn [tbarchyn@gmail.com]
+
+# This project was developed with input from Thomas P.F. Dowling,
+# Chris R. Stokes, and Chris H. Hugenholtz. We would appreciate
+# citation of the relavent publications.
+
+# Barchyn, T. E., T. P. F. Dowling, C. R. Stokes, and C. H. Hugenholtz (2016),
+# Subglacial bed form morphology controlled by ice speed and sediment thickness,
+# Geophys. Res. Lett., 43, doi:10.1002/2016GL069558
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# Please familiarize yourself with the license of this tool, available
+# in the distribution with the filename: /docs/license.txt
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# validate.py: this runs the model side by side in two configurations on the same simfile
+# (with the same random seed) and reports how the stab_kinematics.csv metrics diverge. Run
+# this from the src folder:
+#
+# python validate.py precision [simfile]
+#     compile the model with double and float (-DSTAB_FLOAT) state rasters and compare (on the
+#     shipped test case, test_files/q1.simfile, if no simfile is given)
+# python validate.py squish <simfile>
+#     run the model with the random (Gauss-Seidel style) and jacobi (two pass) squish and compare
+# python validate.py compare <csv_a> <csv_b>
+#     just compare two existing stab_kinematics.csv files
+# python validate.py polltiles <simfile> [tile sizes]
+#     time the squish with the whole grid shuffled and with each poll_tile_size (default 32 64
+#     128), and count the last level cache misses of each run if linux perf is installed. Use
+#     a large grid (e.g., 2000 x 2000 or more), smaller grids fit in cache anyway.
+#
+# The runs are put in a folder called 'validate' next to the simfile. Note that the csv is
+# written with 6 significant figures, so smaller differences do not show up.
+
+import os
+import subprocess
+import shutil
+import sys
+
+# the seed used if the simfile does not set one (the runs need the same random sequence)
+default_seed = '12345'
+
+# the shipped test case, the default simfile for the precision validation
+test_simfile = os.path.join (os.pardir, 'test_files', 'q1.simfile')
+
+# set the executable name based on platform
+if os.name == 'nt':
+    exe_name = 'stab.exe'
+else:
+    exe_name = 'stab'
+
+def compile_model (out_dir, flags):
+    '''
+    function to compile the model into out_dir with the compile time options in flags
+    '''
+    if not os.path.exists (out_dir):
+        os.makedirs (out_dir)
+    exe_path = os.path.join (out_dir, exe_name)
+    exe_call = ['g++', '-Wall', '-pedantic', '-std=c++11', '-pthread', '-O1'] + flags + ['stab_main.cpp', '-o', exe_path]
+    print ('Compiling: ' + ' '.join (exe_call))
+    if subprocess.call (exe_call) != 0:
+        print ('ERROR: compile failed')
+        sys.exit (1)
+    return (exe_path)
+
+def run_model (exe_path, simfile, run_dir, extra_lines = [], wrapper = []):
+    '''
+    function to run the model on a copy of the simfile in run_dir, returns the path to the
+    stab_kinematics.csv file. The extra_lines (e.g., '> squish jacobi') are added to the copy of
+    the simfile, in place of any lines that set the same keys. The wrapper is a command to run
+    the model under (e.g., perf stat).
+    '''
+    if not os.path.exists (run_dir):
+        os.makedirs (run_dir)
+    local_simfile = os.path.join (run_dir, os.path.basename (simfile))
+    shutil.copy2 (simfile, local_simfile)
+
+    # make sure the runs are seeded the same
+    f = open (local_simfile, 'r')
+    text = f.read ()
+    f.close ()
+    if '> seed' not in text:
+        f = open (local_simfile, 'a')
+        f.write ('\n> seed ' + default_seed + '\n')
+        f.close ()
+    if len (extra_lines) > 0:
+        keys = [line.split ()[1] for line in extra_lines]
+        f = open (local_simfile, 'r')
+        lines = [line for line in f if len (line.split ()) < 2 or line.split ()[1] not in keys]
+        f.close ()
+        f = open (local_simfile, 'w')
+        f.write (''.join (lines) + '\n' + '\n'.join (extra_lines) + '\n')
+        f.close ()
+
+    print ('Running: ' + exe_path + ' in ' + run_dir)
+    log = open (os.path.join (run_dir, 'log.txt'), 'w')
+    ret = subprocess.call (wrapper + [os.path.abspath (exe_path), os.path.basename (local_simfile)], cwd = run_dir,
+                           stdout = log, stderr = subprocess.STDOUT)
+    log.close ()
+    if ret != 0:
+        print ('ERROR: model run failed, see ' + os.path.join (run_dir, 'log.txt'))
+        sys.exit (1)
+    return (os.path.join (run_dir, 'stab_kinematics.csv'))
+
+def read_kinematics (csv_path):
+    '''
+    function to read a stab_kinematics.csv file, returns the column names and a list of rows
+    '''
+    f = open (csv_path, 'r')
+    names = f.readline ().strip ().split (',')
+    rows = []
+    for line in f:
+        if line.strip () != '':
+            rows.append ([float (i) for i in line.strip ().split (',')])
+    f.close ()
+    return (names, rows)
+
+def compare_kinematics (csv_a, csv_b, label_a = 'a', label_b = 'b'):
+    '''
+    function to print the divergence of each metric between two stab_kinematics.csv files. The
+    relative difference is the difference over the larger magnitude of the two values.
+    '''
+    names_a, rows_a = read_kinematics (csv_a)
+    names_b, rows_b = read_kinematics (csv_b)
+    if names_a != names_b or len (rows_a) != len (rows_b):
+        print ('ERROR: the kinematics files do not match (different columns or number of rows)')
+        sys.exit (1)
+
+    print ('-------------------------------------------------------------------')
+    print ('Divergence of the kinematics (' + label_a + ' vs ' + label_b + ') over ' + str (len (rows_a)) + ' rows')
+    print ('%-16s %14s %14s %12s %12s' % ('metric', 'final ' + label_a, 'final ' + label_b, 'max abs', 'max rel'))
+    for j in range (1, len (names_a)):
+        max_abs = 0.0
+        max_rel = 0.0
+        for i in range (len (rows_a)):
+            a = rows_a[i][j]
+            b = rows_b[i][j]
+            diff = abs (a - b)
+            scale = max (abs (a), abs (b))
+            max_abs = max (max_abs, diff)
+            if scale > 0.0:
+                max_rel = max (max_rel, diff / scale)
+        print ('%-16s %14.6g %14.6g %12.4g %12.4g' % (names_a[j], rows_a[-1][j], rows_b[-1][j], max_abs, max_rel))
+    print ('-------------------------------------------------------------------')
+
+def validate_precision (simfile):
+    '''
+    function to run the model with double and float state rasters and compare the kinematics
+    '''
+    work_dir = os.path.join (os.path.dirname (os.path.abspath (simfile)), 'validate')
+    exe_double = compile_model (os.path.join (work_dir, 'double'), [])
+    exe_float = compile_model (os.path.join (work_dir, 'float'), ['-DSTAB_FLOAT'])
+    csv_double = run_model (exe_double, simfile, os.path.join (work_dir, 'double', 'run'))
+    csv_float = run_model (exe_float, simfile, os.path.join (work_dir, 'float', 'run'))
+    compare_kinematics (csv_double, csv_float, 'double', 'float')
+
+def validate_squish (simfile):
+    '''
+    function to run the model with the random and jacobi squish and compare the kinematics
+    '''
+    work_dir = os.path.join (os.path.dirname (os.path.abspath (simfile)), 'validate')
+    exe = compile_model (os.path.join (work_dir, 'squish'), [])
+    csv_random = run_model (exe, simfile, os.path.join (work_dir, 'squish', 'random'), ['> squish random'])
+    csv_jacobi = run_model (exe, simfile, os.path.join (work_dir, 'squish', 'jacobi'), ['> squish jacobi'])
+    compare_kinematics (csv_random, csv_jacobi, 'random', 'jacobi')
+
+def find_program (name):
+    '''
+    function to return the path to a program on the PATH, or None
+    '''
+    for folder in os.environ.get ('PATH', '').split (os.pathsep):
+        path = os.path.join (folder, name)
+        if os.path.isfile (path) and os.access (path, os.X_OK):
+            return (path)
+    return (None)
+
+def read_log_value (log_path, prefix):
+    '''
+    function to return the first number after prefix in a run log, or None
+    '''
+    f = open (log_path, 'r')
+    value = None
+    for line in f:
+        if line.startswith (prefix):
+            value = float (line[len (prefix):].split ()[0])
+            break
+    f.close ()
+    return (value)
+
+def validate_polltiles (simfile, tiles):
+    '''
+    function to time the squish with the whole grid shuffled and with each poll tile size, with
+    the last level cache misses of each run if perf is installed
+    '''
+    work_dir = os.path.join (os.path.dirname (os.path.abspath (simfile)), 'validate')
+    exe = compile_model (os.path.join (work_dir, 'polltiles'), [])
+    perf = find_program ('perf')
+    results = []
+    for tile in [0] + tiles:
+        run_dir = os.path.join (work_dir, 'polltiles', 'tile_' + str (tile))
+        wrapper = []
+        if perf is not None:
+            wrapper = [perf, 'stat', '-x', ',', '-e', 'LLC-load-misses', '-o', 'perf.txt', '--']
+        run_model (exe, simfile, run_dir, ['> poll_tile_size ' + str (tile)], wrapper)
+        
+        ns = read_log_value (os.path.join (run_dir, 'log.txt'), 'Squish time per cell visit:')
+        misses = None
+        if perf is not None and os.path.exists (os.path.join (run_dir, 'perf.txt')):
+            f = open (os.path.join (run_dir, 'perf.txt'), 'r')
+            for line in f:
+                fields = line.strip ().split (',')
+                if len (fields) > 2 and fields[2].startswith ('LLC-load-misses') and fields[0].isdigit ():
+                    misses = int (fields[0])
+            f.close ()
+        results.append ((tile, ns, misses))
+    
+    print ('-------------------------------------------------------------------')
+    print ('Squish with poll tiles (0 = whole grid shuffled)')
+    print ('%-12s %20s %20s' % ('tile size', 'ns per cell visit', 'LLC load misses'))
+    for tile, ns, misses in results:
+        print ('%-12s %20s %20s' % (str (tile), '%.1f' % ns if ns is not None else '-',
+                                    str (misses) if misses is not None else 'no perf'))
+    print ('-------------------------------------------------------------------')
+
+if len (sys.argv) == 2 and sys.argv[1] == 'precision':
+    validate_precision (test_simfile)
+elif len (sys.argv) == 3 and sys.argv[1] == 'precision':
+    validate_precision (sys.argv[2])
+elif len (sys.argv) == 3 and sys.argv[1] == 'squish':
+    validate_squish (sys.argv[2])
+elif len (sys.argv) >= 3 and sys.argv[1] == 'polltiles':
+    validate_polltiles (sys.argv[2], [int (i) for i in sys.argv[3:]] if len (sys.argv) > 3 else [32, 64, 128])
+elif len (sys.argv) == 4 and sys.argv[1] == 'compare':
+    compare_kinematics (sys.argv[2], sys.argv[3])
+else:
+    print ('usage: python validate.py precision [simfile]')
+    print ('       python validate.py squish <simfile>')
+    print ('       python validate.py compare <csv_a> <csv_b>')
+    print ('       python validate.py polltiles <simfile> [tile sizes]')